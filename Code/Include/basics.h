@@ -55,14 +55,20 @@ public:
 	explicit Box(const Vector3& A, const Vector3& B);
 	explicit Box(const Vector3& C, float R);
 	explicit Box(const Box& b1, const Box& b2);
+	explicit Box(const Vector3* p, int n);
 
 	bool Contains(const Vector3&) const;
+	bool Intersect(const Box& box) const;
 	Box Extended(const Vector3&) const;
 	float Distance(const Vector3& p) const;
+	float Distance(const Box& box) const;
+	Vector3 DistanceGradient(const Vector3& p) const;
 	Vector3 RandomInside() const;
+	float Volume() const;
 	void SetParallelepipedic(float size, int& x, int& y, int& z);
 	void SetParallelepipedic(int n, int& x, int& y, int& z);
 	Vector3 Vertex(int) const;
+	Vector3 Corner(int) const;
 	Vector3 BottomLeft() const;
 	Vector3 TopRight() const;
 	Vector3& operator[](int i);
@@ -101,6 +107,20 @@ inline Box::Box(const Box& b1, const Box& b2)
 	b = Vector3::Max(b1.b, b2.b);
 }
 
+/*!
+\brief Bounding box of a set of points.
+\param p Points.
+\param n Number of points, should be positive.
+*/
+inline Box::Box(const Vector3* p, int n) : a(p[0]), b(p[0])
+{
+	for (int i = 1; i < n; i++)
+	{
+		a = Vector3::Min(a, p[i]);
+		b = Vector3::Max(b, p[i]);
+	}
+}
+
 /*
 \brief Returns true if p is inside the box, false otherwise.
 \param p world point
@@ -110,6 +130,18 @@ inline bool Box::Contains(const Vector3& p) const
 	return (p > a && p < b);
 }
 
+/*!
+\brief Check if the box intersects another box. Boxes that only share a face do not intersect.
+\param box argument box.
+*/
+inline bool Box::Intersect(const Box& box) const
+{
+	if (((a[0] >= box.b[0]) || (a[1] >= box.b[1]) || (a[2] >= box.b[2]) || (b[0] <= box.a[0]) || (b[1] <= box.a[1]) || (b[2] <= box.a[2])))
+		return false;
+	else
+		return true;
+}
+
 /*
 \brief Returns the extended version of this box, without changing the instance.
 \param r extending factor
@@ -149,6 +181,23 @@ inline void Box::SetParallelepipedic(float size, int& x, int& y, int& z)
 	b = c + e;
 }
 
+/*!
+\brief Compute the gradient of the squared distance between a point and the box.
+\param p point
+*/
+inline Vector3 Box::DistanceGradient(const Vector3& p) const
+{
+	Vector3 g(0.0f);
+	for (int i = 0; i < 3; i++)
+	{
+		if (p[i] < a[i])
+			g[i] = 2.0f * (p[i] - a[i]);
+		else if (p[i] > b[i])
+			g[i] = 2.0f * (p[i] - b[i]);
+	}
+	return g;
+}
+
 /*!
 \brief Inflates a box so that its dimensions should be a fraction of its maximum side length.
 \param n Fraction.
@@ -185,6 +234,29 @@ inline float Box::Distance(const Vector3& p) const
 	return r;
 }
 
+/*!
+\brief Compute the squared distance between two boxes, 0 if they overlap.
+\param box argument box
+*/
+inline float Box::Distance(const Box& box) const
+{
+	float r = 0.0;
+	for (int i = 0; i < 3; i++)
+	{
+		if (box.b[i] < a[i])
+		{
+			float s = box.b[i] - a[i];
+			r += s * s;
+		}
+		else if (box.a[i] > b[i])
+		{
+			float s = box.a[i] - b[i];
+			r += s * s;
+		}
+	}
+	return r;
+}
+
 /*!
 \brief Compute a random point inside a box. Note that this
 is not a uniform sampling if the box is not a regular box (width = height = length).
@@ -203,6 +275,15 @@ inline Vector3 Box::RandomInside() const
 	return (a + b) / 2.0f + Vector3(randw, randh, randl);
 }
 
+/*!
+\brief Compute the volume of the box.
+*/
+inline float Box::Volume() const
+{
+	const Vector3 d = b - a;
+	return d[0] * d[1] * d[2];
+}
+
 /*
 \brief Get one of the vertex of the box.
 */
@@ -213,6 +294,15 @@ inline Vector3 Box::Vertex(int i) const
 	return b;
 }
 
+/*!
+\brief Get one of the eight corners of the box.
+\param i corner index, bits 0, 1 and 2 select the x, y and z coordinates.
+*/
+inline Vector3 Box::Corner(int i) const
+{
+	return Vector3((i & 1) ? b[0] : a[0], (i & 2) ? b[1] : a[1], (i & 4) ? b[2] : a[2]);
+}
+
 /*
 \brief Get bottom left vertex in world coordinates
 */
@@ -733,21 +823,21 @@ public:
 	}
 
 	/*!
-	\brief Check if a point lies inside the bounding box of the field.
+	\brief Check if a row and a column lie inside the grid.
 	*/
 	inline bool Inside(int i, int j) const
 	{
-		if (i < 0 || i >= nx || j < 0 || j >= ny)
+		if (i < 0 || i >= ny || j < 0 || j >= nx)
 			return false;
 		return true;
 	}
 
 	/*!
-	\brief Check if a point lies inside the bounding box of the field.
+	\brief Check if a row and a column lie inside the grid.
 	*/
 	inline bool Inside(const Vector2i& v) const
 	{
-		if (v.x < 0 || v.x >= nx || v.y < 0 || v.y >= ny)
+		if (v.x < 0 || v.x >= ny || v.y < 0 || v.y >= nx)
 			return false;
 		return true;
 	}
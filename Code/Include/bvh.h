@@ -7,6 +7,16 @@ class TNode;
 class TTreeBVH
 {
 public:
+	// Strategies splitting the primitives of a node
+	enum class Split { Middle, VolumeCost };
+
+	static const int Bins = 16;	//!< Number of bins of the volume cost heuristic, along the axis where centers are the most spread.
+
 	static TNode* BVHRecursive(std::vector<TNode*>& pts, unsigned int begin, unsigned int end);
-	static TNode* OptimizeHierarchy(std::vector<TNode*>& pts, unsigned int begin, unsigned int end);
+	static TNode* BVHBinned(std::vector<TNode*>& pts, unsigned int begin, unsigned int end);
+	static TNode* OptimizeHierarchy(std::vector<TNode*>& pts, unsigned int begin, unsigned int end, Split split = Split::Middle);
+	static TNode* Collapse(TNode* node);
+
+protected:
+	static TNode* CollapseBounded(TNode* node);
 };
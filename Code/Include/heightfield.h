@@ -14,4 +14,143 @@ public:
 	~HeightField();
 	
 	ScalarField2D Slope() const;
+
+	bool LoadRaw(const char* url, int nx, int ny, const Box2D& bbox);
+	bool LoadRaw16(const char* url, int nx, int ny, const Box2D& bbox, float a, float b);
+};
+
+// Heightfield stored by square tiles in a file, which is mapped in memory so that
+// the tiles are paged in on demand by the system. Same accessors as ScalarField2D.
+class TiledHeightField
+{
+protected:
+	Box2D box;				//!< Bounding box.
+	int nx, ny;				//!< Size of the grid.
+	int shift;				//!< Size of the tiles, as a power of two.
+	int tx;					//!< Number of tiles along a row.
+	const float* values;	//!< Tiles, stored one after the other.
+
+	void* file;				//!< System handle of the file.
+	void* mapping;			//!< Mapped view of the file.
+	size_t length;			//!< Length of the mapping.
+
+public:
+	TiledHeightField();
+	~TiledHeightField();
+
+	bool Open(const char* url);
+	void Close();
+
+	static bool Create(const char* url, const ScalarField2D& field, int tile = 64);
+	static bool Create(const char* url, const char* raw, int nx, int ny, const Box2D& bbox, int tile = 64);
+
+	/*!
+	\brief Get the value at a given coordinate.
+	*/
+	inline float Get(int row, int column) const
+	{
+		const int mask = (1 << shift) - 1;
+		const size_t t = size_t(row >> shift) * tx + (column >> shift);
+		return values[(t << (2 * shift)) + ((row & mask) << shift) + (column & mask)];
+	}
+
+	/*!
+	\brief Check if a row and a column lie inside the grid.
+	*/
+	inline bool Inside(int i, int j) const
+	{
+		if (i < 0 || i >= ny || j < 0 || j >= nx)
+			return false;
+		return true;
+	}
+
+	/*!
+	\brief Compute the gradient for the vertex (i, j), as ScalarField2D::Gradient().
+	*/
+	inline Vector2 Gradient(int i, int j) const
+	{
+		Vector2 ret;
+		float cellSizeX = (box.Vertex(1).x - box.Vertex(0).x) / (nx - 1);
+		float cellSizeY = (box.Vertex(1).y - box.Vertex(0).y) / (ny - 1);
+
+		// X Gradient
+		if (i == 0)
+			ret.x = (Get(i + 1, j) - Get(i, j)) / cellSizeX;
+		else if (i == ny - 1)
+			ret.x = (Get(i, j) - Get(i - 1, j)) / cellSizeX;
+		else
+			ret.x = (Get(i + 1, j) - Get(i - 1, j)) / (2.0f * cellSizeX);
+
+		// Y Gradient
+		if (j == 0)
+			ret.y = (Get(i, j + 1) - Get(i, j)) / cellSizeY;
+		else if (j == nx - 1)
+			ret.y = (Get(i, j) - Get(i, j - 1)) / cellSizeY;
+		else
+			ret.y = (Get(i, j + 1) - Get(i, j - 1)) / (2.0f * cellSizeY);
+
+		return ret;
+	}
+
+	/*!
+	\brief Compute the value at a given world point with a bilinear interpolation, as ScalarField2D::GetValueBilinear().
+	*/
+	inline float GetValueBilinear(const Vector2& p) const
+	{
+		Vector2 q = p - box.Vertex(0);
+		Vector2 d = box.Vertex(1) - box.Vertex(0);
+
+		float u = q[0] / d[0] * (nx - 1);
+		float v = q[1] / d[1] * (ny - 1);
+
+		int i = int(v);
+		int j = int(u);
+
+		if (!Inside(i, j) || !Inside(i + 1, j + 1))
+			return -1.0f;
+
+		float localU = u - j;
+		float localV = v - i;
+
+		return (1 - localU) * (1 - localV) * Get(i, j)
+			+ (1 - localU) * localV * Get(i + 1, j)
+			+ localU * (1 - localV) * Get(i, j + 1)
+			+ localU * localV * Get(i + 1, j + 1);
+	}
+
+	/*!
+	\brief Returns the size of x-axis of the array.
+	*/
+	inline int SizeX() const
+	{
+		return nx;
+	}
+
+	/*!
+	\brief Returns the size of y-axis of the array.
+	*/
+	inline int SizeY() const
+	{
+		return ny;
+	}
+
+	/*!
+	\brief Returns the bottom left corner of the bounding box.
+	*/
+	inline Vector2 BottomLeft() const
+	{
+		return box.Vertex(0);
+	}
+
+	/*!
+	\brief Returns the top right corner of the bounding box.
+	*/
+	inline Vector2 TopRight() const
+	{
+		return box.Vertex(1);
+	}
+
+private:
+	TiledHeightField(const TiledHeightField&) = delete;
+	TiledHeightField& operator=(const TiledHeightField&) = delete;
 };
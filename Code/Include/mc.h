@@ -0,0 +1,68 @@
+#pragma once
+
+#include "basics.h"
+
+#include <vector>
+
+class TTree;
+struct MesherChunk;
+
+// Marching cubes polygonizer. Buffers are owned by the instance and reused from one call to the next,
+// and instances share no state, so several trees can be polygonized concurrently with one mesher each.
+class Mesher
+{
+protected:
+	int threads;						//!< Thread count, 0 uses every available core.
+	bool adaptive;						//!< Skip the evaluation of regions that the surface does not cross.
+	bool gradients;						//!< Compute the normals from the gradient of the field function.
+
+	int nx, ny, nz;						//!< Grid size.
+	Vector3 origin;						//!< Grid origin.
+	Vector3 cell;						//!< Cell size.
+	int bx, by, bz;						//!< Brick grid size.
+	std::vector<char> bricks;			//!< Brick states: -1 outside, 1 inside, 0 possibly crossed by the surface.
+	std::vector<MesherChunk*> chunks;	//!< Buffers of every range of slabs.
+	long long evaluations;				//!< Number of field function evaluations of the last call.
+	double time;						//!< Duration of the last call, in milliseconds.
+
+	std::vector<Vector3> positions;		//!< Vertex positions.
+	std::vector<Vector3> normals;		//!< Vertex normals.
+	std::vector<int> indices;			//!< Triangle indices.
+
+public:
+	Mesher();
+	~Mesher();
+
+	void SetThreads(int n);
+	void SetAdaptive(bool a);
+	void SetGradientNormals(bool g);
+
+	void Polygonize(const TTree* tree, int res);
+	bool Export(const char* url) const;
+	bool ExportOBJ(const char* url) const;
+	bool ExportPLY(const char* url) const;
+	bool ExportRaw(const char* url) const;
+	bool Load(const char* url);
+	bool LoadPLY(const char* url);
+	bool LoadRaw(const char* url);
+
+	const std::vector<Vector3>& Positions() const;
+	const std::vector<Vector3>& Normals() const;
+	const std::vector<int>& Indices() const;
+	long long Evaluations() const;
+	long long Voxels() const;
+	double Time() const;
+
+protected:
+	int ThreadCount() const;
+	Vector3 GridPoint(int x, int y, int z) const;
+	void GenerateGrid(const TTree* tree, int res);
+	void GenerateBricks(const TTree* tree, const int a[3], const int b[3]);
+	char VoxelState(int x, int y, int z) const;
+	void GenerateSlice(const TTree* tree, MesherChunk& chunk, int z);
+	void GenerateFirstSlice(const TTree* tree, MesherChunk& chunk);
+	void GenerateGeometry(const TTree* tree, MesherChunk& chunk, const MesherChunk* next);
+	void StitchChunks(const TTree* tree);
+};
+
+void marching_cube(const char* url, const TTree* tree, int res);
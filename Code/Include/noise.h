@@ -53,11 +53,29 @@ public:
 		return ((h & 1) == 0 ? u : -u) + ((h & 2) == 0 ? v : -v);
 	}
 
+	// Gradient vector g such that Gradient(hash, x, y, z) = Dot(g, Vector3(x, y, z))
+	static inline Vector3 GradientVector(int hash)
+	{
+		const int h = hash & 15;
+		Vector3 g(0.0f);
+		g[h < 8 ? 0 : 1] = (h & 1) == 0 ? 1.0f : -1.0f;
+		g[h < 4 ? 1 : h == 12 || h == 14 ? 0 : 2] += (h & 2) == 0 ? 1.0f : -1.0f;
+		return g;
+	}
+
 	static inline float GetValue(const Vector2& p)
 	{
 		return GetValue(p.ToVector3(0.0f));
 	}
 
+	static inline float GetValueAndDerivative(const Vector2& p, Vector2& d)
+	{
+		Vector3 g;
+		const float v = GetValueAndDerivative(p.ToVector3(0.0f), g);
+		d = Vector2(g);
+		return v;
+	}
+
 	static inline float GetValue(const Vector3& p)
 	{
 		float x = p.x;
@@ -98,6 +116,85 @@ public:
 		return Math::Lerp(l5, l6, w);
 	}
 
+	// Same as GetValue(), also returning the derivative of the noise with respect to the point
+	static inline float GetValueAndDerivative(const Vector3& p, Vector3& d)
+	{
+		float x = p.x;
+		float y = p.y;
+		float z = p.z;
+
+		// Unit coordinates in cube
+		const int unit_x = int(floor(x)) & 255;
+		const int unit_y = int(floor(y)) & 255;
+		const int unit_z = int(floor(z)) & 255;
+
+		// Relative coordinates in cube
+		x = x - floor(x);
+		y = y - floor(y);
+		z = z - floor(z);
+
+		// Compute fading coefficients
+		const float u = Math::QuinticSmooth(x);
+		const float v = Math::QuinticSmooth(y);
+		const float w = Math::QuinticSmooth(z);
+
+		// Hash cube coordinates
+		const int a = Perm[unit_x] + unit_y;
+		const int aa = Perm[a] + unit_z;
+		const int ab = Perm[a + 1] + unit_z;
+		const int b = Perm[unit_x + 1] + unit_y;
+		const int ba = Perm[b] + unit_z;
+		const int bb = Perm[b + 1] + unit_z;
+
+		// Corner values
+		const float n000 = Gradient(Perm[aa], x, y, z);
+		const float n100 = Gradient(Perm[ba], x - 1, y, z);
+		const float n010 = Gradient(Perm[ab], x, y - 1, z);
+		const float n110 = Gradient(Perm[bb], x - 1, y - 1, z);
+		const float n001 = Gradient(Perm[aa + 1], x, y, z - 1);
+		const float n101 = Gradient(Perm[ba + 1], x - 1, y, z - 1);
+		const float n011 = Gradient(Perm[ab + 1], x, y - 1, z - 1);
+		const float n111 = Gradient(Perm[bb + 1], x - 1, y - 1, z - 1);
+
+		// Interpolate results
+		const float l1 = Math::Lerp(n000, n100, u);
+		const float l2 = Math::Lerp(n010, n110, u);
+		const float l3 = Math::Lerp(n001, n101, u);
+		const float l4 = Math::Lerp(n011, n111, u);
+		const float l5 = Math::Lerp(l1, l2, v);
+		const float l6 = Math::Lerp(l3, l4, v);
+
+		// Interpolated gradients of the corners, and variations along the fading coefficients
+		const Vector3 g1 = Math::Lerp(GradientVector(Perm[aa]), GradientVector(Perm[ba]), u);
+		const Vector3 g2 = Math::Lerp(GradientVector(Perm[ab]), GradientVector(Perm[bb]), u);
+		const Vector3 g3 = Math::Lerp(GradientVector(Perm[aa + 1]), GradientVector(Perm[ba + 1]), u);
+		const Vector3 g4 = Math::Lerp(GradientVector(Perm[ab + 1]), GradientVector(Perm[bb + 1]), u);
+		d = Math::Lerp(Math::Lerp(g1, g2, v), Math::Lerp(g3, g4, v), w);
+		d[0] += Math::QuinticSmoothDerivative(x) * Math::Lerp(Math::Lerp(n100 - n000, n110 - n010, v), Math::Lerp(n101 - n001, n111 - n011, v), w);
+		d[1] += Math::QuinticSmoothDerivative(y) * Math::Lerp(l2 - l1, l4 - l3, w);
+		d[2] += Math::QuinticSmoothDerivative(z) * (l6 - l5);
+
+		return Math::Lerp(l5, l6, w);
+	}
+
+	// Range of the noise over a ball, from its value at the center and the largest slope of the noise.
+	// Gradients have a length of sqrt(2), bounding the noise by sqrt(3/2); the slope, measured below 3.6, is bounded by 4.
+	static inline Vector2 GetRange(const Vector3& p, float radius)
+	{
+		const float v = GetValue(p);
+		const float d = 4.0f * radius;
+		return Vector2(Math::Max(v - d, -1.2248f), Math::Min(v + d, 1.2248f));
+	}
+
+	static inline Vector2 GetRange(const Vector2& p, float radius)
+	{
+		return GetRange(p.ToVector3(0.0f), radius);
+	}
+
+	// Packet versions, vectorized with the instruction set of the processor
+	static void GetValue(const Vector3* p, float* v, int n);
+	static void fBm(const Vector3* p, float* v, int n, float a, float f, int o);
+
 	static inline float fBm(const Vector3& p, float a, float f, int o)
 	{
 		float ret = 0.0f;
@@ -111,4 +208,22 @@ public:
 		}
 		return ret;
 	}
+
+	// Same as fBm(), also returning the derivative of the sum with respect to the point
+	static inline float fBmAndDerivative(const Vector3& p, float a, float f, int o, Vector3& d)
+	{
+		float ret = 0.0f;
+		float freq = f;
+		float amp = a;
+		d = Vector3(0.0f);
+		for (int i = 0; i < o; i++)
+		{
+			Vector3 g;
+			ret += (GetValueAndDerivative(p * freq, g) * 0.5f + 0.5f) * amp;
+			d += g * (0.5f * amp * freq);
+			amp *= 0.5f;
+			freq *= 2.0f;
+		}
+		return ret;
+	}
 };
@@ -3,7 +3,52 @@
 #include "basics.h"
 #include "heightfield.h"
 
+#include <mutex>
+#include <vector>
+
 class GeoTree;
+class TerrainCache;
+
+// Arena of memory blocks from which the nodes of a tree are allocated, released all at once
+class TArena
+{
+public:
+	static const size_t BlockSize = 1 << 16;	//!< Size of the memory blocks.
+	static const size_t Alignment = 16;			//!< Alignment of the allocations, and granularity of their sizes.
+	static const size_t MaxSize = 1024;			//!< Largest allocation recycled through the free lists.
+
+protected:
+	std::vector<char*> blocks;					//!< Memory blocks.
+	char* top;									//!< First free byte of the current block.
+	size_t left;								//!< Number of free bytes in the current block.
+	size_t reserved;							//!< Number of bytes of all blocks.
+	void* released[MaxSize / Alignment + 1];	//!< Lists of released allocations, by size.
+	mutable std::mutex mutex;					//!< Lock of the blocks and lists, shared by the threads of a scope.
+	static thread_local TArena* current;		//!< Arena used by the current thread.
+
+public:
+	TArena();
+	~TArena();
+	TArena(const TArena&) = delete;
+	TArena& operator=(const TArena&) = delete;
+
+	void* Allocate(size_t);
+	void Free(void*, size_t);
+	size_t Memory() const;
+
+	static TArena* Current();
+
+	// Scope within which the nodes created by the current thread are allocated from an arena
+	class Scope
+	{
+	protected:
+		TArena* previous;	//!< Arena used before the scope.
+
+	public:
+		Scope(TArena*);
+		~Scope();
+	};
+};
 
 // Generic node
 class TNode
@@ -12,13 +57,29 @@ protected:
 	Box box;	//!< %Bounding box.
 
 public:
+	static const int PacketSize = 64;	//!< Number of points culled together by batched queries.
+
 	TNode();
 	TNode(const Box&);
 	virtual ~TNode();
 
 	virtual float Intensity(const Vector3&) const;
+	virtual void Intensity(const Vector3*, float*, int) const;
+	virtual void Intensity(const Vector2&, const float*, float*, int) const;
 	virtual Vector3 Gradient(const Vector3&) const;
+	virtual void IntensityGradient(const Vector3&, float&, Vector3&) const;
+	virtual Vector2 Range(const Box&) const;
+	virtual bool Intersect(const Box&) const;
 	virtual Box GetBox() const;
+	virtual bool Bounded() const;
+	virtual float Cost() const;
+
+	static void* operator new(size_t);
+	static void operator delete(void*, size_t);
+	static void Delete(TNode*);
+
+protected:
+	virtual void Detach(std::vector<TNode*>&);
 };
 
 // Generic Primitive Node, without a bounding box.
@@ -38,12 +99,32 @@ protected:
 	float x;		//!< Amplitude.
 	float r;		//!< Radius of influence.
 	Box localbox;	//!< %Box.
+	TerrainCache* cache;	//!< Baked elevations, null if elevations are not cached.
 
 public:
 	TTerrainNode(const Box&, const float& X, const float& E);
+	~TTerrainNode();
+
+	void SetCache(float, float, size_t);
+	float Tolerance() const;
+	float Elevation(const Vector2&) const;
+	void Elevation(const Vector2*, float*, int) const;
 
 	float Intensity(const Vector3&) const;
+	void Intensity(const Vector3*, float*, int) const;
+	void Intensity(const Vector2&, const float*, float*, int) const;
+	Vector3 Gradient(const Vector3&) const;
+	void IntensityGradient(const Vector3&, float&, Vector3&) const;
+	Vector2 Range(const Box&) const;
 	virtual float Height(const Vector2&) const;
+	virtual void Height(const Vector2*, float*, int) const;
+	virtual float Height(const Vector2&, Vector2&) const;
+	virtual Vector2 HeightGradient(const Vector2&) const;
+	virtual Vector2 HeightRange(const Box2D&) const;
+	float Cost() const;
+
+protected:
+	float Potential(const Vector3&, float) const;
 };
 
 // Floating Island primitive used for the paper' images.
@@ -60,6 +141,17 @@ public:
 	TFloatingIsland(const Vector3& c, float r, float, float);
 
 	float Intensity(const Vector3&) const;
+	void Intensity(const Vector3*, float*, int) const;
+	Vector3 Gradient(const Vector3&) const;
+	void IntensityGradient(const Vector3&, float&, Vector3&) const;
+	Vector2 Range(const Box&) const;
+	bool Bounded() const;
+	float Cost() const;
+
+protected:
+	float Potential(const Vector3&, const float*) const;
+	void Elevation(const Vector3&, const float*, float&, float&) const;
+	void Elevation(const Vector3&, float&, float&, Vector3&, Vector3&) const;
 };
 
 // Floating Island primitive used for the paper' images.
@@ -76,6 +168,10 @@ public:
 	TFloatingIsland2(const Vector3& c, const float& r, const float&, const float&);
 
 	float Intensity(const Vector3&) const;
+	void Intensity(const Vector3*, float*, int) const;
+	Vector2 Range(const Box&) const;
+	bool Bounded() const;
+	float Cost() const;
 };
 
 // Heightfield, Elevation computed analytically with some warped noise.
@@ -89,6 +185,43 @@ public:
 	TAnalyticCliff(const Box& B, const Vector2& minMaxElevation);
 
 	float Height(const Vector2&) const;
+	void Height(const Vector2*, float*, int) const;
+	float Height(const Vector2&, Vector2&) const;
+	Vector2 HeightGradient(const Vector2&) const;
+	Vector2 HeightRange(const Box2D&) const;
+	float Cost() const;
+};
+
+// Heightfield, elevation interpolated in a grid.
+class THeightField : public TTerrainNode
+{
+protected:
+	HeightField field;				//!< Elevations, empty if they are mapped from a file.
+	const TiledHeightField* tiled;	//!< Elevations mapped from a file, null if they are stored in field.
+	int nx, ny;						//!< Size of the grid.
+	bool bicubic;					//!< Bicubic interpolation, bilinear otherwise.
+	Vector2 a;						//!< Position of the first sample.
+	Vector2 cell;					//!< Cell size.
+	int tx, ty;						//!< Number of tiles.
+	std::vector<std::vector<Vector2>> tiles;	//!< Minimum and maximum elevations of the tiles, then of the nodes of the quadtree merging them 2x2 up to the root.
+
+public:
+	static const int TileSize = 8;	//!< Number of cells along the side of a tile.
+
+	THeightField(const HeightField&, float, bool = false);
+	THeightField(const TiledHeightField&, float, bool = false);
+
+	float Height(const Vector2&) const;
+	Vector2 HeightRange(const Box2D&) const;
+	bool Intersect(const Box&) const;
+	float Cost() const;
+
+protected:
+	void Initialize(const Vector2&, const Vector2&, float);
+	float Sample(int, int) const;
+	void Tiles(const Box2D&, int[4]) const;
+	void HeightRange(int, int, int, const int[4], Vector2&) const;
+	bool Intersect(int, int, int, const int[4], const Vector2&) const;
 };
 
 // Cubic falloff, used by all skeletal primitives.
@@ -116,17 +249,82 @@ public:
 	TVertex(const Vector3& c, float r, float e);
 
 	virtual float Intensity(const Vector3&) const;
+	void Intensity(const Vector3*, float*, int) const;
+	Vector3 Gradient(const Vector3&) const;
+	void IntensityGradient(const Vector3&, float&, Vector3&) const;
+	Vector2 Range(const Box&) const;
+};
+
+// Segment skeletal primitive, also known as a capsule
+class TSegment : public TCubicFalloff
+{
+protected:
+	Vector3 a;	//!< First end.
+	Vector3 u;	//!< Axis, from the first end to the second one.
+	float k;	//!< Inverse of the squared length of the axis, zero for a point.
+
+public:
+	TSegment(const Vector3& a, const Vector3& b, float r, float e);
+
+	float Intensity(const Vector3&) const;
+	void Intensity(const Vector3*, float*, int) const;
+	Vector3 Gradient(const Vector3&) const;
+	void IntensityGradient(const Vector3&, float&, Vector3&) const;
+	Vector2 Range(const Box&) const;
+	float Cost() const;
+
+protected:
+	Vector3 Offset(const Vector3&) const;
+};
+
+// Set of vertex primitives, stored in arrays sorted by the cells of a grid
+class TVertexCloud : public TNode
+{
+protected:
+	std::vector<float> x, y, z;	//!< Centers.
+	std::vector<float> rr;		//!< Squared radii.
+	std::vector<float> e;		//!< Energies.
+	float radius;				//!< Largest radius.
+	Vector3 origin;				//!< Origin of the grid.
+	float cell;					//!< Cell size.
+	int nx, ny, nz;				//!< Grid size.
+	std::vector<int> cells;		//!< Index of the first vertex of every cell, followed by the number of vertices.
+
+public:
+	TVertexCloud(const std::vector<Vector3>&, const std::vector<float>&, const std::vector<float>&);
+	TVertexCloud(const std::vector<Vector3>&, float, float);
+
+	int Size() const;
+	size_t Memory() const;
+	float Intensity(const Vector3&) const;
+	void Intensity(const Vector3*, float*, int) const;
+	Vector3 Gradient(const Vector3&) const;
+	void IntensityGradient(const Vector3&, float&, Vector3&) const;
+	Vector2 Range(const Box&) const;
+	float Cost() const;
+
+protected:
+	void Cells(const Box&, int[6]) const;
 };
 
 // Binary Operator 
 class TBinary : public TNode
 {
+	friend class TTree;
+	friend class TTreeBVH;
+
 protected:
 	TNode * e[2]; //!< Left and right sub-trees.
+	bool bounded; //!< Whether both sub-trees are bounded by their box.
 
 public:
 	TBinary(TNode*, TNode*);
 	~TBinary();
+
+	bool Bounded() const;
+
+protected:
+	void Detach(std::vector<TNode*>&);
 };
 
 // Blend
@@ -137,7 +335,43 @@ public:
 	TBlend(TNode*, TNode*, TNode*);
 	TBlend(TNode*, TNode*, TNode*, TNode*);
 	float Intensity(const Vector3&) const;
+	void Intensity(const Vector3*, float*, int) const;
+	void Intensity(const Vector2&, const float*, float*, int) const;
+	Vector3 Gradient(const Vector3&) const;
+	void IntensityGradient(const Vector3&, float&, Vector3&) const;
+	Vector2 Range(const Box&) const;
+	float Cost() const;
+};
+
+// Blend of several sub-trees, whose boxes are stored coordinate by coordinate and tested together
+class TWideBlend : public TNode
+{
+public:
+	static const int Width = 8;	//!< Maximum number of sub-trees.
+
+protected:
+	int n;						//!< Number of sub-trees.
+	TNode* e[Width];			//!< Sub-trees.
+	alignas(16) float a[3][Width];	//!< Lower corners of the boxes of the sub-trees, empty boxes for missing ones.
+	alignas(16) float b[3][Width];	//!< Upper corners of the boxes of the sub-trees.
+
+public:
+	TWideBlend(TNode**, int);
+	~TWideBlend();
+
+	float Intensity(const Vector3&) const;
+	void Intensity(const Vector3*, float*, int) const;
+	void Intensity(const Vector2&, const float*, float*, int) const;
 	Vector3 Gradient(const Vector3&) const;
+	void IntensityGradient(const Vector3&, float&, Vector3&) const;
+	Vector2 Range(const Box&) const;
+	bool Bounded() const;
+	float Cost() const;
+
+protected:
+	void Detach(std::vector<TNode*>&);
+	int Overlap(const Vector3&) const;
+	int Overlap(const Vector2&) const;
 };
 
 // Constructive Tree
@@ -145,15 +379,22 @@ class TTree
 {
 private:
 	TNode* root;			//!< Root node.
+	TArena* arena;			//!< Arena owning the nodes, null if they are allocated on the heap.
 	static float t;			//!< %Surface threshold value.
 
 public:
-	TTree(TNode*);
+	TTree(TNode*, TArena* = nullptr);
 	virtual ~TTree();
 
 	float Intensity(const Vector3&) const;
+	void Intensity(const Vector3*, float*, int) const;
+	void Intensity(const Vector2&, const float*, float*, int) const;
 	Vector3 Gradient(const Vector3&) const;
+	void IntensityGradient(const Vector3&, float&, Vector3&) const;
+	Vector2 Range(const Box&) const;
+	bool Intersect(const Box&) const;
 	Box GetBox() const;
+	TArena* GetArena() const;
 	void Blend(TNode*);
 	bool Find(Vector3& p, bool s, const Box& box, int n) const;
 	Vector3 Dichotomy(Vector3 a, Vector3 b, float va, float vb, float length, float epsilon) const;
@@ -161,6 +402,7 @@ public:
 
 	// Static
 	static float T();
-};
 
-void marching_cube(const char* url, const TTree* tree, int res);
+private:
+	static void Rotate(TBlend*);
+};
@@ -42,6 +42,11 @@ namespace Math
 		}
 	}
 
+	inline float StepDerivative(float x, float a, float b)
+	{
+		return (x < a || x > b) ? 0.0f : 1.0f / (b - a);
+	}
+
 	template<typename T>
 	inline T Min(T a, T b)
 	{
@@ -70,6 +75,11 @@ namespace Math
 		return (x > r) ? 0.0f : (1.0f - x / r)*(1.0f - x / r)*(1.0f - x / r);
 	}
 
+	inline float CubicSmoothCompactDerivative(float x, float r)
+	{
+		return (x > r) ? 0.0f : -3.0f / r * (1.0f - x / r)*(1.0f - x / r);
+	}
+
 	inline float CubicSigmoid(float x, float r, float t)
 	{
 		if (x > 0.0f)
@@ -98,6 +108,15 @@ namespace Math
 		}
 	}
 
+	inline float CubicSigmoidDerivative(float x, float r, float t)
+	{
+		// Symmetric
+		float y = Abs(x);
+		if (y >= r)
+			return 0.0f;
+		return 1.0f + y * (2.0f * (3.0f*t - 2.0f*r) / (r*r) + 3.0f * y * (r - 2.0f*t) / (r*r*r));
+	}
+
 	inline float CubicSmooth(float x)
 	{
 		return x * x * (3.0f - 2.0f * x);
@@ -118,10 +137,23 @@ namespace Math
 			return 1.0f - CubicSmooth((x - a) * (x - a), (b - a) * (b - a));
 	}
 
+	inline float CubicSmoothStepDerivative(float x, float a, float b)
+	{
+		if (x < a || x > b)
+			return 0.0f;
+		const float y = 1.0f - (x - a) * (x - a) / ((b - a) * (b - a));
+		return 6.0f * (x - a) * y * y / ((b - a) * (b - a));
+	}
+
 	inline float QuinticSmooth(float t)
 	{
 		return pow(t, 3.0f) * (t * (t * 6.0f - 15.0f) + 10.0f);
 	}
+
+	inline float QuinticSmoothDerivative(float t)
+	{
+		return 30.0f * t * t * (t * (t - 2.0f) + 1.0f);
+	}
 }
 
 
@@ -444,3 +476,10 @@ inline bool operator<=(const Vector2& u, const Vector2& v)
 {
 	return (u.x <= v.x) && (u.y <= v.y);
 }
+
+// Product of two intervals, given by their lower and upper bounds
+inline Vector2 IntervalProduct(const Vector2& u, const Vector2& v)
+{
+	const float a = u.x * v.x, b = u.x * v.y, c = u.y * v.x, d = u.y * v.y;
+	return Vector2(Math::Min(Math::Min(a, b), Math::Min(c, d)), Math::Max(Math::Max(a, b), Math::Max(c, d)));
+}
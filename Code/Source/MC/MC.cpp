@@ -10,12 +10,22 @@
 
 #include <iostream>
 #include <fstream>
+#include <string>
+#include <cstring>
+#include <cerrno>
+#include <limits>
 
+#include "mc.h"
 #include "ttree.h"
 
 #include <cmath>
 #include <cstdlib>
 #include <cstdint>
+#include <chrono>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 
 //------------------------------------------------------------------------------
@@ -428,10 +438,33 @@ struct Vertex
 	Vec3f normal;
 };
 
-static std::vector<float> voxels;
-static std::vector<Vertex> vertices;
-static std::vector<int> indices;
-static int nx, ny, nz;
+// Vertex created on the first plane of a chunk, duplicating a vertex of the previous chunk
+struct Seam
+{
+	int vertex;		// Index in the chunk
+	int offset;		// Offset of the edge in the plane
+	int axis;		// Axis of the edge
+};
+
+// Geometry generated from a range of z-slabs, with its own buffers
+struct MesherChunk
+{
+	int z0, z1;							// Cells in [z0, z1)
+	std::vector<float> voxels;			// Two consecutive z-slices of the field function
+	std::vector<float> first;			// Field function on the z0 plane, also the last plane of the previous chunk
+	std::vector<Vec3i> slab_inds;		// Edge vertices of two consecutive z-slices
+	std::vector<Vec3i> top;				// Edge vertices of the z1 plane
+	std::vector<Vertex> vertices;
+	std::vector<int> indices;
+	std::vector<Seam> seam;
+	std::vector<int> remap;				// Index of the vertices in the stitched mesh
+	std::vector<float> ordinates;		// Ordinates of the points of a column evaluated together
+	std::vector<float> values;			// Field function at those points
+	std::vector<int> rows;				// Voxels of those points along the column
+	long long evaluations;
+};
+
+static const int brick = 8;			// Size of the octree leaves, in cells
 
 static inline int offset_3d(const Vec3i &p, const Vec3i &size)
 {
@@ -443,29 +476,6 @@ static inline int offset_3d_slab(const Vec3i &p, const Vec3i &size)
 	return size.x * size.y * (p.z % 2) + p.y * size.x + p.x;
 }
 
-static void generate_voxels(const TTree* tree, int res)
-{
-	Box clipped = tree->GetBox();
-	clipped.SetParallelepipedic(res, nx, ny, nz);
-	Vector3 d = clipped[1] - clipped[0];
-	d.x /= (nx - 1);
-	d.y /= (ny - 1);
-	d.z /= (nz - 1);
-	voxels.resize(nx * ny * nz);
-	for (int x = 0; x < nx; x++)
-	{
-		for (int y = 0; y < ny; y++)
-		{
-			for (int z = 0; z < nz; z++)
-			{
-				const int offset = offset_3d({ x, y, z }, Vec3i(nx, ny, nz));
-				Vector3 p = Vector3(clipped[0] + Vector3(x * d[0], y * d[1], z * d[2]));
-				voxels[offset] = tree->Intensity(p);
-			}
-		}
-	}
-}
-
 static const uint64_t marching_cube_tris[256] = {
 	0ULL, 33793ULL, 36945ULL, 159668546ULL,
 	18961ULL, 144771090ULL, 5851666ULL, 595283255635ULL,
@@ -533,7 +543,7 @@ static const uint64_t marching_cube_tris[256] = {
 	143955266ULL, 2385ULL, 18433ULL, 0ULL,
 };
 
-static void triangle(int a, int b, int c)
+static void triangle(std::vector<Vertex> &vertices, int a, int b, int c)
 {
 	Vertex &va = vertices[a];
 	Vertex &vb = vertices[b];
@@ -546,26 +556,302 @@ static void triangle(int a, int b, int c)
 	vc.normal += n;
 }
 
-static void generate_geometry_smooth()
+
+/*!
+\class Mesher mc.h
+\brief Marching cubes polygonizer of a terrain construction tree.
+
+The grid is streamed slice by slice and split in ranges of slabs meshed in parallel, so that
+memory only grows with the size of the surface. An octree over bricks of cells skips the evaluation
+of the field function where the tree proves that the surface cannot be.
+*/
+
+/*!
+\brief Create a mesher using every available core, with the adaptive evaluation enabled.
+*/
+Mesher::Mesher() : threads(0), adaptive(true), gradients(true), nx(0), ny(0), nz(0), bx(0), by(0), bz(0), evaluations(0), time(0.0)
+{
+}
+
+/*!
+\brief Release the buffers.
+*/
+Mesher::~Mesher()
+{
+	for (MesherChunk* chunk : chunks)
+		delete chunk;
+}
+
+/*!
+\brief Set the number of threads used to evaluate the field function and extract the geometry.
+\param n Thread count, 0 uses every available core.
+*/
+void Mesher::SetThreads(int n)
+{
+	threads = n;
+}
+
+/*!
+\brief Enable or disable the octree that skips the evaluation of the field function
+in regions proven to be entirely inside or outside the surface.
+\param a Flag.
+*/
+void Mesher::SetAdaptive(bool a)
+{
+	adaptive = a;
+}
+
+/*!
+\brief Set whether the vertex normals are computed from the gradient of the field function,
+or by averaging the normals of the adjacent triangles.
+\param g Flag.
+*/
+void Mesher::SetGradientNormals(bool g)
+{
+	gradients = g;
+}
+
+/*!
+\brief Returns the vertex positions of the last polygonized surface.
+*/
+const std::vector<Vector3>& Mesher::Positions() const
+{
+	return positions;
+}
+
+/*!
+\brief Returns the vertex normals of the last polygonized surface.
+*/
+const std::vector<Vector3>& Mesher::Normals() const
+{
+	return normals;
+}
+
+/*!
+\brief Returns the triangle indices of the last polygonized surface.
+*/
+const std::vector<int>& Mesher::Indices() const
+{
+	return indices;
+}
+
+/*!
+\brief Returns the number of field function evaluations of the last polygonization.
+*/
+long long Mesher::Evaluations() const
+{
+	return evaluations;
+}
+
+/*!
+\brief Returns the number of voxels of the grid of the last polygonization, which a dense evaluation computes.
+*/
+long long Mesher::Voxels() const
+{
+	return (long long)(nx) * ny * nz;
+}
+
+/*!
+\brief Returns the duration of the last polygonization, in milliseconds.
+*/
+double Mesher::Time() const
 {
-	static std::vector<Vec3i> slab_inds(nx * ny * 2);
+	return time;
+}
+
+/*!
+\brief Compute the number of threads actually used.
+*/
+int Mesher::ThreadCount() const
+{
+#ifdef _OPENMP
+	return threads > 0 ? threads : omp_get_max_threads();
+#else
+	return 1;
+#endif
+}
+
+/*!
+\brief Compute the world position of a voxel.
+*/
+inline Vector3 Mesher::GridPoint(int x, int y, int z) const
+{
+	return Vector3(origin + Vector3(x * cell[0], y * cell[1], z * cell[2]));
+}
 
-	for (int z = 0; z < nx - 1; z++) 
+/*!
+\brief Classify the bricks in [a, b) by bounding the field function over the voxels they span,
+subdividing like an octree until the surface is excluded or a single brick is left.
+\param tree Tree.
+\param a, b Range of bricks.
+*/
+void Mesher::GenerateBricks(const TTree* tree, const int a[3], const int b[3])
+{
+	const Box region(GridPoint(a[0] * brick, a[1] * brick, a[2] * brick),
+		GridPoint(min(b[0] * brick, nx - 1), min(b[1] * brick, ny - 1), min(b[2] * brick, nz - 1)));
+	const Vector2 range = tree->Range(region);
+
+	// Keep a margin, as the bound and the field are not computed with the same rounding errors
+	const float epsilon = 1e-3f * TTree::T();
+	char state = 0;
+	if (range[1] < -epsilon)
+		state = -1;
+	else if (range[0] > epsilon)
+		state = 1;
+
+	if (state != 0 || (b[0] - a[0] == 1 && b[1] - a[1] == 1 && b[2] - a[2] == 1))
 	{
+		for (int k = a[2]; k < b[2]; k++)
+			for (int j = a[1]; j < b[1]; j++)
+				for (int i = a[0]; i < b[0]; i++)
+					bricks[(k * by + j) * bx + i] = state;
+		return;
+	}
+
+	const Vec3i m((a[0] + b[0]) / 2, (a[1] + b[1]) / 2, (a[2] + b[2]) / 2);
+	for (int c = 0; c < 8; c++)
+	{
+		const Vec3i ca((c & 1) ? m.x : a[0], (c & 2) ? m.y : a[1], (c & 4) ? m.z : a[2]);
+		const Vec3i cb((c & 1) ? b[0] : m.x, (c & 2) ? b[1] : m.y, (c & 4) ? b[2] : m.z);
+		if (ca.x < cb.x && ca.y < cb.y && ca.z < cb.z)
+			GenerateBricks(tree, ca.data, cb.data);
+	}
+}
+
+/*!
+\brief Returns 0 if one of the bricks sharing the voxel may be crossed by the surface,
+or the sign of the field function otherwise.
+*/
+inline char Mesher::VoxelState(int x, int y, int z) const
+{
+	char state = 0;
+	for (int c = 0; c < 8; c++)
+	{
+		if (((c & 1) && x % brick != 0) || ((c & 2) && y % brick != 0) || ((c & 4) && z % brick != 0))
+			continue;
+		const int i = x / brick - (c & 1);
+		const int j = y / brick - ((c >> 1) & 1);
+		const int k = z / brick - ((c >> 2) & 1);
+		if (i < 0 || j < 0 || k < 0 || i >= bx || j >= by || k >= bz)
+			continue;
+		state = bricks[(k * by + j) * bx + i];
+		if (state == 0)
+			return 0;
+	}
+	return state;
+}
+
+/*!
+\brief Compute the grid covering the tree, and classify its bricks.
+\param tree Tree.
+\param res Resolution along the largest side of the box.
+*/
+void Mesher::GenerateGrid(const TTree* tree, int res)
+{
+	Box clipped = tree->GetBox();
+	clipped.SetParallelepipedic(res, nx, ny, nz);
+	cell = clipped[1] - clipped[0];
+	cell.x /= (nx - 1);
+	cell.y /= (ny - 1);
+	cell.z /= (nz - 1);
+	origin = clipped[0];
+
+	if (adaptive)
+	{
+		bx = (nx - 2) / brick + 1;
+		by = (ny - 2) / brick + 1;
+		bz = (nz - 2) / brick + 1;
+		bricks.resize(bx * by * bz);
+		const int a[3] = { 0, 0, 0 };
+		const int b[3] = { bx, by, bz };
+		GenerateBricks(tree, a, b);
+	}
+}
+
+/*!
+\brief Evaluate a slice of the field function in the buffer of a chunk.
+Voxels inside uniform bricks only need the sign of the field function, the others are
+evaluated column by column with a single query, so that terrain elevations are computed once per column.
+*/
+void Mesher::GenerateSlice(const TTree* tree, MesherChunk &chunk, int z)
+{
+	chunk.ordinates.resize(ny);
+	chunk.values.resize(ny);
+	chunk.rows.resize(ny);
+	for (int x = 0; x < nx; x++)
+	{
+		int n = 0;
+		for (int y = 0; y < ny; y++)
+		{
+			const char state = adaptive ? VoxelState(x, y, z) : 0;
+			chunk.voxels[offset_3d_slab({ x, y, z }, Vec3i(nx, ny, nz))] = state * TTree::T();
+			if (state == 0)
+			{
+				chunk.ordinates[n] = GridPoint(x, y, z)[1];
+				chunk.rows[n++] = y;
+			}
+		}
+		if (n == 0)
+			continue;
+		tree->Intensity(Vector2(GridPoint(x, 0, z)), chunk.ordinates.data(), chunk.values.data(), n);
+		for (int i = 0; i < n; i++)
+			chunk.voxels[offset_3d_slab({ x, chunk.rows[i], z }, Vec3i(nx, ny, nz))] = chunk.values[i];
+		chunk.evaluations += n;
+	}
+}
+
+/*!
+\brief Evaluate the first plane of a chunk, and keep a copy for the previous chunk whose last plane it is.
+*/
+void Mesher::GenerateFirstSlice(const TTree* tree, MesherChunk &chunk)
+{
+	chunk.voxels.resize(nx * ny * 2);
+	chunk.evaluations = 0;
+	GenerateSlice(tree, chunk, chunk.z0);
+	const int offset = offset_3d_slab({ 0, 0, chunk.z0 }, Vec3i(nx, ny, nz));
+	chunk.first.assign(chunk.voxels.begin() + offset, chunk.voxels.begin() + offset + nx * ny);
+}
+
+/*!
+\brief Polygonize the slabs of a chunk in its own buffers, its first plane being already evaluated.
+\param tree Tree.
+\param chunk Chunk.
+\param next Next chunk, whose first plane is the last plane of the chunk, null for the last chunk.
+*/
+void Mesher::GenerateGeometry(const TTree* tree, MesherChunk &chunk, const MesherChunk* next)
+{
+	chunk.slab_inds.resize(nx * ny * 2);
+	chunk.vertices.clear();
+	chunk.indices.clear();
+	chunk.seam.clear();
+
+	const std::vector<float> &voxels = chunk.voxels;
+	std::vector<Vec3i> &slab_inds = chunk.slab_inds;
+	std::vector<Vertex> &vertices = chunk.vertices;
+	std::vector<int> &indices = chunk.indices;
+	const int z0 = chunk.z0;
+
+	// Stream the grid: only slices z and z + 1 are kept in memory
+	for (int z = z0; z < chunk.z1; z++) 
+	{
+		if (z + 1 == chunk.z1 && next != nullptr)
+			std::copy(next->first.begin(), next->first.end(), chunk.voxels.begin() + offset_3d_slab({ 0, 0, z + 1 }, Vec3i(nx, ny, nz)));
+		else
+			GenerateSlice(tree, chunk, z + 1);
 		for (int y = 0; y < ny - 1; y++) 
 		{
-			for (int x = 0; x < nz - 1; x++) 
+			for (int x = 0; x < nx - 1; x++) 
 			{
 				const Vec3i p(x, y, z);
 				const float vs[8] = {
-					voxels[offset_3d({x,   y,   z},   Vec3i(nx, ny, nz))],
-					voxels[offset_3d({x + 1, y,   z},   Vec3i(nx, ny, nz))],
-					voxels[offset_3d({x,   y + 1, z},   Vec3i(nx, ny, nz))],
-					voxels[offset_3d({x + 1, y + 1, z},   Vec3i(nx, ny, nz))],
-					voxels[offset_3d({x,   y,   z + 1}, Vec3i(nx, ny, nz))],
-					voxels[offset_3d({x + 1, y,   z + 1}, Vec3i(nx, ny, nz))],
-					voxels[offset_3d({x,   y + 1, z + 1}, Vec3i(nx, ny, nz))],
-					voxels[offset_3d({x + 1, y + 1, z + 1}, Vec3i(nx, ny, nz))],
+					voxels[offset_3d_slab({x,   y,   z},   Vec3i(nx, ny, nz))],
+					voxels[offset_3d_slab({x + 1, y,   z},   Vec3i(nx, ny, nz))],
+					voxels[offset_3d_slab({x,   y + 1, z},   Vec3i(nx, ny, nz))],
+					voxels[offset_3d_slab({x + 1, y + 1, z},   Vec3i(nx, ny, nz))],
+					voxels[offset_3d_slab({x,   y,   z + 1}, Vec3i(nx, ny, nz))],
+					voxels[offset_3d_slab({x + 1, y,   z + 1}, Vec3i(nx, ny, nz))],
+					voxels[offset_3d_slab({x,   y + 1, z + 1}, Vec3i(nx, ny, nz))],
+					voxels[offset_3d_slab({x + 1, y + 1, z + 1}, Vec3i(nx, ny, nz))],
 				};
 
 				const int config_n =
@@ -588,20 +874,22 @@ static void generate_geometry_smooth()
 					Vec3f v = ToVec3f(p);
 					v[axis] += va / (va - vb);
 					slab_inds[offset_3d_slab(p, Vec3i(nx, ny, nz))][axis] = int32_t(vertices.size());
+					if (axis != 2 && p.z == z0 && z0 != 0)
+						chunk.seam.push_back({ int(vertices.size()), p.y * nx + p.x, axis });
 					vertices.push_back({ v, Vec3f(0) });
 				};
 
-				if (p.y == 0 && p.z == 0)
+				if (p.y == 0 && p.z == z0)
 					do_edge(0, vs[0], vs[1], 0, Vec3i(x, y, z));
-				if (p.z == 0)
+				if (p.z == z0)
 					do_edge(1, vs[2], vs[3], 0, Vec3i(x, y + 1, z));
 				if (p.y == 0)
 					do_edge(2, vs[4], vs[5], 0, Vec3i(x, y, z + 1));
 				do_edge(3, vs[6], vs[7], 0, Vec3i(x, y + 1, z + 1));
 
-				if (p.x == 0 && p.z == 0)
+				if (p.x == 0 && p.z == z0)
 					do_edge(4, vs[0], vs[2], 1, Vec3i(x, y, z));
-				if (p.z == 0)
+				if (p.z == z0)
 					do_edge(5, vs[1], vs[3], 1, Vec3i(x + 1, y, z));
 				if (p.x == 0)
 					do_edge(6, vs[4], vs[6], 1, Vec3i(x, y, z + 1));
@@ -641,7 +929,7 @@ static void generate_geometry_smooth()
 					offset += 4;
 				}
 				for (int i = 0; i < n_triangles; i++) {
-					triangle(
+					triangle(vertices,
 						indices[index_base + i * 3 + 0],
 						indices[index_base + i * 3 + 1],
 						indices[index_base + i * 3 + 2]);
@@ -649,40 +937,573 @@ static void generate_geometry_smooth()
 			}
 		}
 	}
-	for (Vertex &v : vertices)
-		v.normal = -normalize(v.normal);
+
+	// Keep the vertices of the last plane, shared with the next chunk
+	chunk.top.assign(slab_inds.begin() + (chunk.z1 % 2) * nx * ny, slab_inds.begin() + (chunk.z1 % 2 + 1) * nx * ny);
 }
 
+/*!
+\brief Concatenate the chunks and weld the vertices duplicated on their shared planes.
 
-void marching_cube(const char* url, const TTree* tree, int res)
+Vertices and triangles keep the order of a serial extraction, only the normals of
+the welded vertices may differ by rounding errors, as they are summed in two parts.
+Normals are then replaced by the gradient of the field function, if enabled.
+*/
+void Mesher::StitchChunks(const TTree* tree)
 {
-	// Clear old data
-	vertices.clear();
-	indices.clear();
-	voxels.clear();
+	const int n = int(chunks.size());
+	std::vector<int> vertex_offset(n + 1, 0);
+	std::vector<int> index_offset(n + 1, 0);
+	for (int k = 0; k < n; k++)
+	{
+		vertex_offset[k + 1] = vertex_offset[k] + int(chunks[k]->vertices.size() - chunks[k]->seam.size());
+		index_offset[k + 1] = index_offset[k] + int(chunks[k]->indices.size());
+	}
+	std::vector<Vertex> vertices(vertex_offset[n]);
+	indices.resize(index_offset[n]);
 
-	// Query field function
-	generate_voxels(tree, res);
+#pragma omp parallel for num_threads(n) schedule(static, 1)
+	for (int k = 0; k < n; k++)
+	{
+		MesherChunk &chunk = *chunks[k];
+		chunk.remap.assign(chunk.vertices.size(), 0);
+		for (const Seam &s : chunk.seam)
+			chunk.remap[s.vertex] = -1;
+		int j = vertex_offset[k];
+		for (int i = 0; i < int(chunk.vertices.size()); i++)
+		{
+			if (chunk.remap[i] == -1)
+				continue;
+			chunk.remap[i] = j;
+			vertices[j++] = chunk.vertices[i];
+		}
+	}
 
-	// Generate geometry
-	generate_geometry_smooth();
+#pragma omp parallel for num_threads(n) schedule(static, 1)
+	for (int k = 0; k < n; k++)
+	{
+		MesherChunk &chunk = *chunks[k];
+		for (const Seam &s : chunk.seam)
+		{
+			const int i = chunks[k - 1]->remap[chunks[k - 1]->top[s.offset][s.axis]];
+			chunk.remap[s.vertex] = i;
+			vertices[i].normal += chunk.vertices[s.vertex].normal;
+		}
+		for (int i = 0; i < int(chunk.indices.size()); i++)
+			indices[index_offset[k] + i] = chunk.remap[chunk.indices[i]];
+	}
+
+	positions.resize(vertices.size());
+	normals.resize(vertices.size());
+#pragma omp parallel for num_threads(n)
+	for (int i = 0; i < int(vertices.size()); i++)
+	{
+		const Vec3f p = vertices[i].position;
+		const Vec3f nn = -normalize(vertices[i].normal);
+		positions[i] = Vector3(p.x, p.y, p.z);
+		normals[i] = Vector3(nn.x, nn.y, nn.z);
+
+		// Vertices are in grid coordinates: sample the field at the world point and scale its gradient by the cell size.
+		// The field function increases inside, falling back to triangles where it is flat
+		if (gradients)
+		{
+			const Vector3 g = tree->Gradient(origin + Vector3(p.x * cell[0], p.y * cell[1], p.z * cell[2]));
+			if (g != Vector3(0.0f))
+				normals[i] = -Normalize(Vector3(g[0] * cell[0], g[1] * cell[1], g[2] * cell[2]));
+		}
+	}
+}
+
+/*!
+\brief Polygonize the surface of a tree.
+\param tree Tree.
+\param res Resolution along the largest side of the box.
+*/
+void Mesher::Polygonize(const TTree* tree, int res)
+{
+	// Query field function and generate geometry slice by slice, one range of slices per thread.
+	// Planes shared by consecutive chunks are evaluated once, before the chunks are polygonized
+	auto start = std::chrono::high_resolution_clock::now();
+	GenerateGrid(tree, res);
+	const int n = min(ThreadCount(), nz - 1);
+	while (int(chunks.size()) < n)
+		chunks.push_back(new MesherChunk);
+	while (int(chunks.size()) > n)
+	{
+		delete chunks.back();
+		chunks.pop_back();
+	}
+	for (int k = 0; k < n; k++)
+	{
+		chunks[k]->z0 = (nz - 1) * k / n;
+		chunks[k]->z1 = (nz - 1) * (k + 1) / n;
+	}
+#pragma omp parallel for num_threads(n) schedule(static, 1)
+	for (int k = 0; k < n; k++)
+		GenerateFirstSlice(tree, *chunks[k]);
+#pragma omp parallel for num_threads(n) schedule(static, 1)
+	for (int k = 0; k < n; k++)
+		GenerateGeometry(tree, *chunks[k], k + 1 < n ? chunks[k + 1] : nullptr);
+	StitchChunks(tree);
+	auto end = std::chrono::high_resolution_clock::now();
+	time = std::chrono::duration<double, std::milli>(end - start).count();
+
+	evaluations = 0;
+	for (const MesherChunk* chunk : chunks)
+		evaluations += chunk->evaluations;
+}
+
+// Returns true if the file name ends with the given extension
+static bool has_extension(const char* url, const char* extension)
+{
+	const std::string s(url);
+	const std::string e(extension);
+	return s.size() >= e.size() && s.compare(s.size() - e.size(), e.size(), e) == 0;
+}
+
+// Binary files are written and read in blocks of this size, in bytes
+static const size_t block_size = 1 << 22;
+
+// Header of the raw format, followed by the positions, the normals and the indices
+struct RawHeader
+{
+	char magic[4];		// "ITMR"
+	uint32_t version;
+	uint32_t vertices;
+	uint32_t indices;
+};
+
+static_assert(sizeof(Vector3) == 3 * sizeof(float), "Vector3 must be packed to be written as a block");
+
+// Parse a non-negative integer written alone on the rest of a line, return false if it is not one
+static bool parse_count(const std::string& s, unsigned long long& count)
+{
+	const char* begin = s.c_str();
+	while (*begin == ' ')
+		begin++;
+	if (*begin < '0' || *begin > '9')
+		return false;
+	char* end;
+	errno = 0;
+	count = std::strtoull(begin, &end, 10);
+	while (*end == ' ' || *end == '\r')
+		end++;
+	return errno == 0 && *end == '\0';
+}
 
-	// Export as .obj file
-	std::ofstream out;
-	out.open(url);
+// Number of bytes between the current position of a stream and its end
+static unsigned long long remaining_bytes(std::ifstream& in)
+{
+	const std::streampos position = in.tellg();
+	in.seekg(0, std::ios::end);
+	const std::streampos end = in.tellg();
+	in.seekg(position);
+	return position < 0 || end < position ? 0 : (unsigned long long)(end - position);
+}
+
+// Check that triangle indices refer to existing vertices
+static bool valid_indices(const std::vector<int>& indices, size_t vertices)
+{
+	for (int i : indices)
+		if (i < 0 || size_t(i) >= vertices)
+			return false;
+	return true;
+}
+
+/*!
+\brief Export the last polygonized surface, the format being selected with the extension of the file:
+binary .ply, .raw for a dump of the buffers, or .obj otherwise.
+\param url File name.
+\return True if the file could be written.
+*/
+bool Mesher::Export(const char* url) const
+{
+	if (has_extension(url, ".ply"))
+		return ExportPLY(url);
+	if (has_extension(url, ".raw"))
+		return ExportRaw(url);
+	return ExportOBJ(url);
+}
+
+/*!
+\brief Load a surface exported as a binary .ply or a .raw file, selected with the extension of the file.
+\param url File name.
+\return True if the file could be read.
+*/
+bool Mesher::Load(const char* url)
+{
+	if (has_extension(url, ".ply"))
+		return LoadPLY(url);
+	if (has_extension(url, ".raw"))
+		return LoadRaw(url);
+	return false;
+}
+
+/*!
+\brief Export the last polygonized surface as a little-endian binary .ply file,
+with float positions and normals and triangles stored as lists of int indices.
+
+Vertices and faces are packed in large blocks, so that writing is not slowed down by formatting.
+The host is assumed to be little-endian, as are x86 and ARM processors.
+\param url File name.
+\return True if the file could be written.
+*/
+bool Mesher::ExportPLY(const char* url) const
+{
+	std::ofstream out(url, std::ios::binary);
 	if (out.is_open() == false)
-		return;
-	out << "g " << "Obj" << std::endl;
-	for (int i = 0; i < vertices.size(); i++)
-		out << "v " << vertices.at(i).position.x << " " << vertices.at(i).position.y << " " << vertices.at(i).position.z << '\n';
-	for (int i = 0; i < vertices.size(); i++)
-		out << "vn " << vertices.at(i).normal.x << " " << vertices.at(i).normal.y << " " << vertices.at(i).normal.z << '\n';
-	for (int i = 0; i < indices.size(); i += 3)
+		return false;
+	out << "ply\n"
+		<< "format binary_little_endian 1.0\n"
+		<< "element vertex " << positions.size() << "\n"
+		<< "property float x\nproperty float y\nproperty float z\n"
+		<< "property float nx\nproperty float ny\nproperty float nz\n"
+		<< "element face " << indices.size() / 3 << "\n"
+		<< "property list uchar int vertex_indices\n"
+		<< "end_header\n";
+
+	std::vector<char> buffer;
+	buffer.reserve(block_size + 64);
+	auto flush = [&]() {
+		out.write(buffer.data(), buffer.size());
+		buffer.clear();
+	};
+	for (size_t i = 0; i < positions.size(); i++)
+	{
+		const char* p = reinterpret_cast<const char*>(&positions[i]);
+		const char* n = reinterpret_cast<const char*>(&normals[i]);
+		buffer.insert(buffer.end(), p, p + sizeof(Vector3));
+		buffer.insert(buffer.end(), n, n + sizeof(Vector3));
+		if (buffer.size() >= block_size)
+			flush();
+	}
+	for (size_t i = 0; i + 2 < indices.size(); i += 3)
+	{
+		const char* f = reinterpret_cast<const char*>(&indices[i]);
+		buffer.push_back(3);
+		buffer.insert(buffer.end(), f, f + 3 * sizeof(int));
+		if (buffer.size() >= block_size)
+			flush();
+	}
+	flush();
+	return out.good();
+}
+
+/*!
+\brief Load a binary .ply file written by ExportPLY().
+Other layouts of vertices or faces are rejected.
+\param url File name.
+\return True if the file could be read.
+*/
+bool Mesher::LoadPLY(const char* url)
+{
+	std::ifstream in(url, std::ios::binary);
+	if (in.is_open() == false)
+		return false;
+
+	// Header
+	std::string line;
+	std::string expected[] = { "ply", "format binary_little_endian 1.0", "element vertex",
+		"property float x", "property float y", "property float z",
+		"property float nx", "property float ny", "property float nz",
+		"element face", "property list uchar int vertex_indices", "end_header" };
+	unsigned long long vertexCount = 0, faceCount = 0;
+	for (const std::string& e : expected)
+	{
+		if (!std::getline(in, line) || line.compare(0, e.size(), e) != 0)
+			return false;
+		if (e == "element vertex" && !parse_count(line.substr(e.size()), vertexCount))
+			return false;
+		else if (e == "element face" && !parse_count(line.substr(e.size()), faceCount))
+			return false;
+	}
+
+	// Counts should match the size of the file, which also bounds the allocations
+	const unsigned long long vertexSize = 6 * sizeof(float), faceSize = 1 + 3 * sizeof(int);
+	const unsigned long long remaining = remaining_bytes(in);
+	if (vertexCount > remaining / vertexSize || faceCount > (remaining - vertexCount * vertexSize) / faceSize
+		|| vertexCount * vertexSize + faceCount * faceSize != remaining || vertexCount > unsigned(std::numeric_limits<int>::max()))
+		return false;
+
+	// Vertices
+	std::vector<float> buffer(size_t(vertexCount) * 6);
+	if (!in.read(reinterpret_cast<char*>(buffer.data()), buffer.size() * sizeof(float)))
+		return false;
+	const size_t vertices = size_t(vertexCount);
+	std::vector<Vector3> p(vertices), n(vertices);
+	for (size_t i = 0; i < p.size(); i++)
 	{
-		out << "f " << indices.at(i) + 1 << "//" << indices.at(i) + 1
-			<< " " << indices.at(i + 1) + 1 << "//" << indices.at(i + 1) + 1
-			<< " " << indices.at(i + 2) + 1 << "//" << indices.at(i + 2) + 1
-			<< '\n';
+		p[i] = Vector3(buffer[6 * i], buffer[6 * i + 1], buffer[6 * i + 2]);
+		n[i] = Vector3(buffer[6 * i + 3], buffer[6 * i + 4], buffer[6 * i + 5]);
 	}
-	out.close();
+
+	// Triangles
+	std::vector<char> faces(size_t(faceCount * faceSize));
+	if (!in.read(faces.data(), faces.size()))
+		return false;
+	std::vector<int> t(size_t(faceCount) * 3);
+	for (size_t i = 0; i < size_t(faceCount); i++)
+	{
+		if (faces[i * faceSize] != 3)
+			return false;
+		memcpy(&t[3 * i], &faces[i * faceSize + 1], 3 * sizeof(int));
+	}
+	if (!valid_indices(t, p.size()))
+		return false;
+
+	// The surface is only replaced once the whole file is read
+	positions.swap(p);
+	normals.swap(n);
+	indices.swap(t);
+	return true;
+}
+
+/*!
+\brief Export the last polygonized surface as a dump of its buffers: a small header followed
+by the positions, the normals and the indices, each written as a single block.
+\param url File name.
+\return True if the file could be written.
+*/
+bool Mesher::ExportRaw(const char* url) const
+{
+	std::ofstream out(url, std::ios::binary);
+	if (out.is_open() == false)
+		return false;
+	const RawHeader header = { { 'I', 'T', 'M', 'R' }, 1, uint32_t(positions.size()), uint32_t(indices.size()) };
+	out.write(reinterpret_cast<const char*>(&header), sizeof(RawHeader));
+	out.write(reinterpret_cast<const char*>(positions.data()), positions.size() * sizeof(Vector3));
+	out.write(reinterpret_cast<const char*>(normals.data()), normals.size() * sizeof(Vector3));
+	out.write(reinterpret_cast<const char*>(indices.data()), indices.size() * sizeof(int));
+	return out.good();
+}
+
+/*!
+\brief Load a .raw file written by ExportRaw().
+\param url File name.
+\return True if the file could be read.
+*/
+bool Mesher::LoadRaw(const char* url)
+{
+	std::ifstream in(url, std::ios::binary);
+	if (in.is_open() == false)
+		return false;
+	RawHeader header;
+	if (!in.read(reinterpret_cast<char*>(&header), sizeof(RawHeader)))
+		return false;
+	if (memcmp(header.magic, "ITMR", 4) != 0 || header.version != 1)
+		return false;
+
+	// Counts are 32 bits, so the expected size cannot overflow
+	const unsigned long long size = 2ull * header.vertices * sizeof(Vector3) + 1ull * header.indices * sizeof(int);
+	if (size != remaining_bytes(in) || header.indices % 3 != 0 || header.vertices > unsigned(std::numeric_limits<int>::max()))
+		return false;
+
+	std::vector<Vector3> p(header.vertices), n(header.vertices);
+	std::vector<int> t(header.indices);
+	in.read(reinterpret_cast<char*>(p.data()), p.size() * sizeof(Vector3));
+	in.read(reinterpret_cast<char*>(n.data()), n.size() * sizeof(Vector3));
+	in.read(reinterpret_cast<char*>(t.data()), t.size() * sizeof(int));
+	if (!in || !valid_indices(t, p.size()))
+		return false;
+
+	positions.swap(p);
+	normals.swap(n);
+	indices.swap(t);
+	return true;
+}
+
+// Lines of an .obj file formatted by a single task
+static const int obj_lines = 1 << 15;
+
+// Write a positive integer, return the end of the text
+static char* format_int(char* s, unsigned int i)
+{
+	char digits[10];
+	int n = 0;
+	do
+	{
+		digits[n++] = char('0' + i % 10);
+		i /= 10;
+	} while (i != 0);
+	while (n > 0)
+		*s++ = digits[--n];
+	return s;
+}
+
+// Write a float with six significant digits, exactly as printf("%g") and std::ostream do
+// with the default precision, but without locale nor stream overhead; return the end of the text
+static char* format_float(char* s, float f)
+{
+	static double powers[121];
+	static const bool init = [&]() {
+		for (int i = 0; i < 121; i++)
+			powers[i] = std::pow(10.0, i - 60);
+		return true;
+	}();
+	(void)init;
+
+	if (std::signbit(f))
+	{
+		*s++ = '-';
+		f = -f;
+	}
+	if (std::isnan(f) || std::isinf(f))
+	{
+		const char* t = std::isnan(f) ? "nan" : "inf";
+		for (int i = 0; i < 3; i++)
+			*s++ = t[i];
+		return s;
+	}
+	if (f == 0.0f)
+	{
+		*s++ = '0';
+		return s;
+	}
+
+	// Six digits integer mantissa and decimal exponent
+	const double d = f;
+	int k = int(std::floor(std::log10(d)));
+	auto scale = [&](int p) { return p >= 0 ? d * powers[60 + p] : d / powers[60 - p]; };
+	double scaled = scale(5 - k);
+	if (scaled < 1e5)
+		scaled = scale(5 - --k);
+	else if (scaled >= 1e6)
+		scaled = scale(5 - ++k);
+	const double fl = std::floor(scaled);
+	int mantissa = int(fl);
+	if (scaled - fl > 0.5 || (scaled - fl == 0.5 && (mantissa & 1)))
+		mantissa++;
+	if (mantissa == 1000000)
+	{
+		mantissa = 100000;
+		k++;
+	}
+	char digits[6];
+	for (int i = 5; i >= 0; i--, mantissa /= 10)
+		digits[i] = char('0' + mantissa % 10);
+	int last = 5;
+	while (last > 0 && digits[last] == '0')
+		last--;
+
+	if (k < -4 || k >= 6)
+	{
+		*s++ = digits[0];
+		if (last > 0)
+		{
+			*s++ = '.';
+			for (int i = 1; i <= last; i++)
+				*s++ = digits[i];
+		}
+		*s++ = 'e';
+		*s++ = k < 0 ? '-' : '+';
+		if (k < 0)
+			k = -k;
+		if (k < 10)
+			*s++ = '0';
+		return format_int(s, k);
+	}
+	if (k >= 0)
+	{
+		for (int i = 0; i <= k; i++)
+			*s++ = digits[i];
+		if (last > k)
+		{
+			*s++ = '.';
+			for (int i = k + 1; i <= last; i++)
+				*s++ = digits[i];
+		}
+		return s;
+	}
+	*s++ = '0';
+	*s++ = '.';
+	for (int i = 1; i < -k; i++)
+		*s++ = '0';
+	for (int i = 0; i <= last; i++)
+		*s++ = digits[i];
+	return s;
+}
+
+/*!
+\brief Export the last polygonized surface as an .obj file.
+
+Lines are formatted into memory by blocks in parallel, and blocks are written in order
+once a batch is complete, so that exporting large meshes is bound by the disk.
+\param url File name.
+\return True if the file could be written.
+*/
+bool Mesher::ExportOBJ(const char* url) const
+{
+	std::ofstream out(url, std::ios::binary);
+	if (out.is_open() == false)
+		return false;
+	out << "g " << "Obj" << '\n';
+
+	// Lines are numbered across vertices, normals and triangles
+	const long long vertexCount = positions.size();
+	const long long lineCount = 2 * vertexCount + indices.size() / 3;
+	const long long blockCount = (lineCount + obj_lines - 1) / obj_lines;
+	const int batch = 4 * ThreadCount();
+	std::vector<std::vector<char> > blocks(batch);
+	for (long long b0 = 0; b0 < blockCount; b0 += batch)
+	{
+		const int n = int(std::min<long long>(batch, blockCount - b0));
+#pragma omp parallel for schedule(dynamic) num_threads(ThreadCount())
+		for (int b = 0; b < n; b++)
+		{
+			const long long l0 = (b0 + b) * obj_lines;
+			const long long l1 = std::min(l0 + obj_lines, lineCount);
+
+			// Longest lines are normals, 3 x 13 characters, and triangles, 3 x 23 characters
+			std::vector<char>& block = blocks[b];
+			block.resize((l1 - l0) * 80);
+			char* s = block.data();
+			for (long long l = l0; l < l1; l++)
+			{
+				if (l < 2 * vertexCount)
+				{
+					const bool normal = l >= vertexCount;
+					const Vector3& v = normal ? normals[l - vertexCount] : positions[l];
+					*s++ = 'v';
+					if (normal)
+						*s++ = 'n';
+					for (int i = 0; i < 3; i++)
+					{
+						*s++ = ' ';
+						s = format_float(s, v[i]);
+					}
+				}
+				else
+				{
+					const int* t = &indices[3 * (l - 2 * vertexCount)];
+					*s++ = 'f';
+					for (int i = 0; i < 3; i++)
+					{
+						*s++ = ' ';
+						s = format_int(s, t[i] + 1);
+						*s++ = '/';
+						*s++ = '/';
+						s = format_int(s, t[i] + 1);
+					}
+				}
+				*s++ = '\n';
+			}
+			block.resize(s - block.data());
+		}
+		for (int b = 0; b < n; b++)
+			out.write(blocks[b].data(), blocks[b].size());
+	}
+	return out.good();
+}
+
+/*!
+\brief Polygonize the surface of a tree and export it as an .obj file, with a temporary mesher.
+\param url File name.
+\param tree Tree.
+\param res Resolution along the largest side of the box.
+*/
+void marching_cube(const char* url, const TTree* tree, int res)
+{
+	Mesher mesher;
+	mesher.Polygonize(tree, res);
+	mesher.Export(url);
 }
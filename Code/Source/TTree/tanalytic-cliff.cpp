@@ -40,3 +40,142 @@ float TAnalyticCliff::Height(const Vector2& p) const
 	// Check bounds, just to be sure
 	return Math::Clamp(z, minMaxElevation[0], minMaxElevation[1]);
 }
+
+/*!
+\brief Compute the elevation and its gradient, differentiating the noises analytically.
+\param p Point.
+\param g Returned gradient.
+*/
+float TAnalyticCliff::Height(const Vector2& p, Vector2& g) const
+{
+	Vector2 q = p - c;
+	Vector2 d[8];
+
+	// Cliffs
+	float zc = minMaxElevation[0] + 15.0f * PerlinNoise::GetValueAndDerivative(q / 500.0f, d[0]) + 7.0f * PerlinNoise::GetValueAndDerivative(q / 300.0f, d[1]) + 2.0f * PerlinNoise::GetValueAndDerivative(q / 150.0f, d[2]);
+	zc += minMaxElevation[1] * (0.5f + 0.5f * PerlinNoise::GetValueAndDerivative(q / 1050.0f, d[3]));
+	Vector2 gc = d[0] * (15.0f / 500.0f) + d[1] * (7.0f / 300.0f) + d[2] * (2.0f / 150.0f) + d[3] * (0.5f * minMaxElevation[1] / 1050.0f);
+
+	// Sea shore
+	float zs = minMaxElevation[0] + 10.0f;
+
+	// Interpolant, the noises being sampled in the plane y = 0.24
+	Vector3 d4, d5;
+	Vector2 qq = q + 135.0f * PerlinNoise::GetValueAndDerivative(q.ToVector3(0.24f) / 150.0f, d4) + 75.0f * PerlinNoise::GetValueAndDerivative(q.ToVector3(0.24f) / 70.0f, d5);
+	Vector2 gq = Vector2(1.0f, 0.0f) + Vector2(d4) * (135.0f / 150.0f) + Vector2(d5) * (75.0f / 70.0f);
+
+	float u = Math::CubicSmoothStep(qq[0], -35.0f, 25.0f);
+	float z = Math::Lerp(zs, zc, u);
+	g = gc * u + gq * (Math::CubicSmoothStepDerivative(qq[0], -35.0f, 25.0f) * (zc - zs));
+
+	// Global smooth slope towards the sea
+	z += minMaxElevation[0] * Math::Step(-qq[0], -500.0f, 500.0f) + 2.0f * PerlinNoise::GetValueAndDerivative(q / 50.0f, d[6]) + 1.0f * PerlinNoise::GetValueAndDerivative(q / 25.0f, d[7]);
+	g = g - gq * (minMaxElevation[0] * Math::StepDerivative(-qq[0], -500.0f, 500.0f)) + d[6] * (2.0f / 50.0f) + d[7] * (1.0f / 25.0f);
+
+	// Check bounds, just to be sure
+	if (z < minMaxElevation[0] || z > minMaxElevation[1])
+		g = Vector2(0.0f);
+	return Math::Clamp(z, minMaxElevation[0], minMaxElevation[1]);
+}
+
+/*!
+\copydoc TTerrainNode::HeightGradient
+*/
+Vector2 TAnalyticCliff::HeightGradient(const Vector2& p) const
+{
+	Vector2 g;
+	Height(p, g);
+	return g;
+}
+
+/*!
+\brief Compute the minimum and maximum elevation over a domain, following Height() with intervals.
+Every noise is bounded over the disc enclosing the domain, see PerlinNoise::GetRange(), and both
+smooth steps of the interpolant are monotonic.
+\param b Domain.
+*/
+Vector2 TAnalyticCliff::HeightRange(const Box2D& b) const
+{
+	const Vector2 q = b.Center() - c;
+	const float radius = Magnitude(b[1] - b[0]) / 2.0f;
+
+	// Cliffs
+	Vector2 zc = PerlinNoise::GetRange(q / 500.0f, radius / 500.0f) * 15.0f + PerlinNoise::GetRange(q / 300.0f, radius / 300.0f) * 7.0f + PerlinNoise::GetRange(q / 150.0f, radius / 150.0f) * 2.0f + minMaxElevation[0];
+	zc = zc + IntervalProduct(Vector2(minMaxElevation[1]), PerlinNoise::GetRange(q / 1050.0f, radius / 1050.0f) * 0.5f + 0.5f);
+
+	// Sea shore
+	float zs = minMaxElevation[0] + 10.0f;
+
+	// Interpolant
+	Vector2 qq = Vector2(b[0][0], b[1][0]) - c[0] + PerlinNoise::GetRange(q.ToVector3(0.24f) / 150.0f, radius / 150.0f) * 135.0f + PerlinNoise::GetRange(q.ToVector3(0.24f) / 70.0f, radius / 70.0f) * 75.0f;
+
+	Vector2 u(Math::CubicSmoothStep(qq[0], -35.0f, 25.0f), Math::CubicSmoothStep(qq[1], -35.0f, 25.0f));
+	Vector2 z = IntervalProduct(zc - zs, u) + zs;
+
+	// Global smooth slope towards the sea
+	z = z + IntervalProduct(Vector2(minMaxElevation[0]), Vector2(Math::Step(-qq[1], -500.0f, 500.0f), Math::Step(-qq[0], -500.0f, 500.0f)));
+	z = z + PerlinNoise::GetRange(q / 50.0f, radius / 50.0f) * 2.0f + PerlinNoise::GetRange(q / 25.0f, radius / 25.0f);
+
+	return Vector2(Math::Clamp(z[0], minMaxElevation[0], minMaxElevation[1]), Math::Clamp(z[1], minMaxElevation[0], minMaxElevation[1]));
+}
+
+/*!
+\brief Returns the relative cost of the evaluation, dominated by the eight octaves of noise.
+*/
+float TAnalyticCliff::Cost() const
+{
+	return 60.0f;
+}
+
+/*!
+\brief Compute the elevation at a set of points, same as Height() with packets of noise.
+\param p Points.
+\param h Returned elevations.
+\param n Number of points.
+*/
+void TAnalyticCliff::Height(const Vector2* p, float* h, int n) const
+{
+	Vector2 q[PacketSize];
+	Vector3 s[PacketSize];
+	float noise[8][PacketSize];
+	for (int k = 0; k < n; k += PacketSize)
+	{
+		const int m = Math::Min(n - k, PacketSize);
+		for (int i = 0; i < m; i++)
+			q[i] = p[k + i] - c;
+		auto octave = [&](float* v, auto f) {
+			for (int i = 0; i < m; i++)
+				s[i] = f(q[i]);
+			PerlinNoise::GetValue(s, v, m);
+		};
+		octave(noise[0], [](const Vector2& q) { return (q / 500.0f).ToVector3(0.0f); });
+		octave(noise[1], [](const Vector2& q) { return (q / 300.0f).ToVector3(0.0f); });
+		octave(noise[2], [](const Vector2& q) { return (q / 150.0f).ToVector3(0.0f); });
+		octave(noise[3], [](const Vector2& q) { return (q / 1050.0f).ToVector3(0.0f); });
+		octave(noise[4], [](const Vector2& q) { return q.ToVector3(0.24f) / 150.0f; });
+		octave(noise[5], [](const Vector2& q) { return q.ToVector3(0.24f) / 70.0f; });
+		octave(noise[6], [](const Vector2& q) { return (q / 50.0f).ToVector3(0.0f); });
+		octave(noise[7], [](const Vector2& q) { return (q / 25.0f).ToVector3(0.0f); });
+
+		for (int i = 0; i < m; i++)
+		{
+			// Cliffs
+			float zc = minMaxElevation[0] + 15.0f * noise[0][i] + 7.0f * noise[1][i] + 2.0f * noise[2][i];
+			zc += minMaxElevation[1] * (0.5f + 0.5f * noise[3][i]);
+
+			// Sea shore
+			float zs = minMaxElevation[0] + 10.0f;
+
+			// Interpolant
+			Vector2 qq = q[i] + 135.0f * noise[4][i] + 75.0f * noise[5][i];
+
+			float u = Math::CubicSmoothStep(qq[0], -35.0f, 25.0f);
+			float z = Math::Lerp(zs, zc, u);
+
+			// Global smooth slope towards the sea
+			z += minMaxElevation[0] * Math::Step(-qq[0], -500.0f, 500.0f) + 2.0f * noise[6][i] + 1.0f * noise[7][i];
+
+			h[k + i] = Math::Clamp(z, minMaxElevation[0], minMaxElevation[1]);
+		}
+	}
+}
@@ -0,0 +1,120 @@
+#include "ttree.h"
+
+/*!
+\class TArena ttree.h
+\brief Memory from which the nodes of a tree are allocated.
+
+Nodes are carved one after the other from large blocks, so that the nodes created together, such as
+the primitives of a scene and the blends of the hierarchy built over them, sit next to each other in memory.
+Deleted nodes are recycled through free lists sorted by size, and the blocks are released all at once with
+the arena, which must hence outlive its nodes. Every thread allocating from the arena opens its own
+TArena::Scope, see TNode::operator new(), and allocations are serialized by a lock.
+*/
+
+thread_local TArena* TArena::current = nullptr;
+
+/*!
+\brief Create an empty arena.
+*/
+TArena::TArena() : top(nullptr), left(0), reserved(0)
+{
+	for (void*& r : released)
+		r = nullptr;
+}
+
+/*!
+\brief Release all blocks. Nodes created afterwards by the thread are allocated on the heap, even within the scope of the arena.
+*/
+TArena::~TArena()
+{
+	if (current == this)
+		current = nullptr;
+	for (char* block : blocks)
+		::operator delete(block);
+}
+
+/*!
+\brief Allocate memory, from the free list of its size if it is not empty, at the top of the current block otherwise.
+\param size Size, in bytes.
+*/
+void* TArena::Allocate(size_t size)
+{
+	size = (size + Alignment - 1) / Alignment * Alignment;
+	std::lock_guard<std::mutex> lock(mutex);
+	if (size <= MaxSize && released[size / Alignment] != nullptr)
+	{
+		void* p = released[size / Alignment];
+		released[size / Alignment] = *static_cast<void**>(p);
+		return p;
+	}
+
+	// Large allocations get a block of their own
+	if (size > BlockSize / 4)
+	{
+		blocks.push_back(static_cast<char*>(::operator new(size)));
+		reserved += size;
+		return blocks.back();
+	}
+
+	if (size > left)
+	{
+		blocks.push_back(static_cast<char*>(::operator new(BlockSize)));
+		top = blocks.back();
+		left = BlockSize;
+		reserved += BlockSize;
+	}
+	void* p = top;
+	top += size;
+	left -= size;
+	return p;
+}
+
+/*!
+\brief Return memory to the arena, which will reuse it for allocations of the same size.
+Large allocations are only released with the arena.
+\param p Memory.
+\param size Size, in bytes, as given to Allocate().
+*/
+void TArena::Free(void* p, size_t size)
+{
+	size = (size + Alignment - 1) / Alignment * Alignment;
+	if (size > MaxSize)
+		return;
+	std::lock_guard<std::mutex> lock(mutex);
+	*static_cast<void**>(p) = released[size / Alignment];
+	released[size / Alignment] = p;
+}
+
+/*!
+\brief Return the memory reserved by the arena, in bytes.
+*/
+size_t TArena::Memory() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return reserved;
+}
+
+/*!
+\brief Return the arena from which the current thread allocates nodes, null if nodes are allocated on the heap.
+*/
+TArena* TArena::Current()
+{
+	return current;
+}
+
+/*!
+\brief Allocate the nodes created by the current thread from an arena until the end of the scope.
+\param arena Arena, null to allocate nodes on the heap.
+*/
+TArena::Scope::Scope(TArena* arena) : previous(current)
+{
+	current = arena;
+}
+
+/*!
+\brief Restore the arena used before the scope.
+*/
+TArena::Scope::~Scope()
+{
+	current = previous;
+}
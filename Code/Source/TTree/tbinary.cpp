@@ -14,13 +14,39 @@ TBinary::TBinary(TNode* a, TNode* b)
 	e[0] = a;
 	e[1] = b;
 	box = Box(e[0]->GetBox(), e[1]->GetBox());
+	bounded = e[0]->Bounded() && e[1]->Bounded();
 }
 
 /*!
-\brief Recursively delete the sub-trees.
+\brief Delete the sub-trees, see TNode::Delete().
 */
 TBinary::~TBinary()
 {
-	delete e[0];
-	delete e[1];
+	Delete(e[0]);
+	Delete(e[1]);
+}
+
+/*!
+\brief Check whether both sub-trees are bounded by their box, and hence by the box of the node.
+
+The flag is computed once by the constructor, as sub-trees are only replaced by sub-trees that are
+bounded alike, see TTree::Blend() and TTreeBVH::Collapse().
+*/
+bool TBinary::Bounded() const
+{
+	return bounded;
+}
+
+/*!
+\brief Move the sub-trees to a stack.
+\param stack Stack.
+*/
+void TBinary::Detach(std::vector<TNode*>& stack)
+{
+	for (TNode*& c : e)
+	{
+		if (c != nullptr)
+			stack.push_back(c);
+		c = nullptr;
+	}
 }
@@ -46,6 +46,98 @@ float TBlend::Intensity(const Vector3& p) const
 	return e[0]->Intensity(p) + e[1]->Intensity(p);
 }
 
+/*!
+\brief Compute the intensity at a set of points.
+
+Packets lying outside of the box are skipped, packets lying inside are given to the sub-trees as they are,
+otherwise the points inside the box are gathered in a smaller packet.
+\param p Points.
+\param v Returned intensities.
+\param n Number of points.
+*/
+void TBlend::Intensity(const Vector3* p, float* v, int n) const
+{
+	Vector3 q[PacketSize];
+	float a[PacketSize];
+	float b[PacketSize];
+	int index[PacketSize];
+	for (int k = 0; k < n; k += PacketSize)
+	{
+		const int m = Math::Min(n - k, PacketSize);
+		const Vector3* pk = p + k;
+		float* vk = v + k;
+		const Box packet(pk, m);
+		if (!box.Intersect(packet))
+		{
+			for (int i = 0; i < m; i++)
+				vk[i] = 0.0f;
+		}
+		else if (packet[0] > box[0] && packet[1] < box[1])
+		{
+			e[0]->Intensity(pk, vk, m);
+			e[1]->Intensity(pk, b, m);
+			for (int i = 0; i < m; i++)
+				vk[i] = vk[i] + b[i];
+		}
+		else
+		{
+			int l = 0;
+			for (int i = 0; i < m; i++)
+			{
+				vk[i] = 0.0f;
+				if (box.Contains(pk[i]))
+				{
+					index[l] = i;
+					q[l++] = pk[i];
+				}
+			}
+			if (l == 0)
+				continue;
+			e[0]->Intensity(q, a, l);
+			e[1]->Intensity(q, b, l);
+			for (int j = 0; j < l; j++)
+				vk[index[j]] = a[j] + b[j];
+		}
+	}
+}
+
+/*!
+\brief Compute the intensity along a vertical column.
+Columns missing the box are skipped, otherwise the points inside the box are gathered by packets.
+\param p Horizontal coordinates of the column.
+\param y Ordinates of the points.
+\param v Returned intensities.
+\param n Number of points.
+*/
+void TBlend::Intensity(const Vector2& p, const float* y, float* v, int n) const
+{
+	float q[PacketSize];
+	float a[PacketSize];
+	float b[PacketSize];
+	int index[PacketSize];
+	const bool cull = !(p[0] > box[0][0] && p[0] < box[1][0] && p[1] > box[0][2] && p[1] < box[1][2]);
+	for (int k = 0; k < n; k += PacketSize)
+	{
+		const int m = Math::Min(n - k, PacketSize);
+		int l = 0;
+		for (int i = k; i < k + m; i++)
+		{
+			v[i] = 0.0f;
+			if (!cull && y[i] > box[0][1] && y[i] < box[1][1])
+			{
+				index[l] = i;
+				q[l++] = y[i];
+			}
+		}
+		if (l == 0)
+			continue;
+		e[0]->Intensity(p, q, a, l);
+		e[1]->Intensity(p, q, b, l);
+		for (int j = 0; j < l; j++)
+			v[index[j]] = a[j] + b[j];
+	}
+}
+
 /*!
 \brief Compute the gradient for the blend at a given point, defined as G0 + G1.
 \param p Point.
@@ -56,3 +148,44 @@ Vector3 TBlend::Gradient(const Vector3& p) const
 		return Vector3(0.0);
 	return e[0]->Gradient(p) + e[1]->Gradient(p);
 }
+
+/*!
+\brief Compute the intensity and the gradient at a given point, with a single traversal of the sub-trees.
+\param p Point.
+\param v Returned intensity.
+\param g Returned gradient.
+*/
+void TBlend::IntensityGradient(const Vector3& p, float& v, Vector3& g) const
+{
+	if (!box.Contains(p))
+	{
+		v = 0.0f;
+		g = Vector3(0.0f);
+		return;
+	}
+	float va, vb;
+	Vector3 ga, gb;
+	e[0]->IntensityGradient(p, va, ga);
+	e[1]->IntensityGradient(p, vb, gb);
+	v = va + vb;
+	g = ga + gb;
+}
+
+/*!
+\brief Compute the intensity range of the blend in a box, defined as R0 + R1.
+\param b Box.
+*/
+Vector2 TBlend::Range(const Box& b) const
+{
+	if (!box.Intersect(b))
+		return Vector2(0.0f);
+	return e[0]->Range(b) + e[1]->Range(b);
+}
+
+/*!
+\brief Returns the cost of the evaluation of both sub-trees.
+*/
+float TBlend::Cost() const
+{
+	return e[0]->Cost() + e[1]->Cost();
+}
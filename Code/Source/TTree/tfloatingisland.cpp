@@ -11,6 +11,8 @@ protected:
 public:
 	SmoothDisc2D(const Vector2&, float, float);
 	float Intensity(const Vector2&) const;
+	float Intensity(const Vector2&, Vector2&) const;
+	Vector2 Range(const Box2D&) const;
 };
 
 /*!
@@ -47,6 +49,42 @@ float SmoothDisc2D::Intensity(const Vector2& p) const
 	return Math::CubicSmooth(d, fr * fr);
 }
 
+/*!
+\brief Compute a smooth intensity inside the disc, and its gradient.
+\param p Point.
+\param g Returned gradient.
+*/
+float SmoothDisc2D::Intensity(const Vector2& p, Vector2& g) const
+{
+	Vector2 cp = p - c;
+	float d = Dot(cp, cp);
+	float rre = r + fr;
+
+	g = Vector2(0.0f);
+	if (d > rre * rre)
+		return 0.0f;
+	if (d < r * r)
+		return 1.0f;
+
+	d = sqrt(d);
+	if (d > 0.0f)
+		g = cp * (Math::CubicSmoothCompactDerivative((d - r) * (d - r), fr * fr) * 2.0f * (d - r) / d);
+	d -= r;
+	d *= d;
+
+	return Math::CubicSmooth(d, fr * fr);
+}
+
+/*!
+\brief Compute the intensity range over a domain, the intensity decreasing with the distance to the center.
+\param b Domain.
+*/
+Vector2 SmoothDisc2D::Range(const Box2D& b) const
+{
+	const float dx = Math::Max(Math::Abs(b[0][0] - c[0]), Math::Abs(b[1][0] - c[0]));
+	const float dy = Math::Max(Math::Abs(b[0][1] - c[1]), Math::Abs(b[1][1] - c[1]));
+	return Vector2(Intensity(c + Vector2(sqrt(dx * dx + dy * dy), 0.0f)), Intensity(c + Vector2(sqrt(b.Distance(c)), 0.0f)));
+}
 
 /*!
 \class TFloatingIsland ttree.h
@@ -61,6 +99,10 @@ TFloatingIsland::TFloatingIsland(const Vector3& c, float r, float depth, float h
 	box = localbox.Extended(Vector3(r));
 }
 
+// Scales and offsets of the noises defining the elevations of TFloatingIsland
+static const float NoiseScale[8] = { 30.0f, 14.0f, 7.0f, 4.0f, 2.0f, 89.0f, 46.0f, 14.0f };
+static const float NoiseOffset[8] = { 0.54f, 0.63f, 0.13f, 0.79f, 0.79f, 0.0f, 0.0f, 0.0f };
+
 /*!
 \brief Compute the intensity.
 
@@ -68,17 +110,102 @@ TFloatingIsland::TFloatingIsland(const Vector3& c, float r, float depth, float h
 */
 float TFloatingIsland::Intensity(const Vector3& q) const
 {
-	// @Todo: optimize all this.
 	Vector3 p = q - c;
 
 	if (!box.Contains(p))
 		return 0.0f;
 
+	float noise[8];
+	for (int i = 0; i < 8; i++)
+		noise[i] = PerlinNoise::GetValue(p / NoiseScale[i] + NoiseOffset[i]);
+	return Potential(p, noise);
+}
+
+/*!
+\brief Compute the intensity at a set of points.
+Packets lying outside of the box are skipped, and the noises are evaluated by packets.
+\param p Points.
+\param v Returned intensities.
+\param n Number of points.
+*/
+void TFloatingIsland::Intensity(const Vector3* p, float* v, int n) const
+{
+	Vector3 q[PacketSize];
+	Vector3 s[PacketSize];
+	float noise[8][PacketSize];
+	int index[PacketSize];
+	for (int k = 0; k < n; k += PacketSize)
+	{
+		const int m = Math::Min(n - k, PacketSize);
+		const Box packet(p + k, m);
+		const bool cull = !box.Intersect(Box(packet[0] - c, packet[1] - c));
+		int l = 0;
+		for (int i = k; i < k + m; i++)
+		{
+			v[i] = 0.0f;
+			const Vector3 pc = p[i] - c;
+			if (!cull && box.Contains(pc))
+			{
+				index[l] = i;
+				q[l++] = pc;
+			}
+		}
+		for (int o = 0; o < 8; o++)
+		{
+			for (int j = 0; j < l; j++)
+				s[j] = q[j] / NoiseScale[o] + NoiseOffset[o];
+			PerlinNoise::GetValue(s, noise[o], l);
+		}
+		for (int j = 0; j < l; j++)
+		{
+			float nj[8];
+			for (int o = 0; o < 8; o++)
+				nj[o] = noise[o][j];
+			v[index[j]] = Potential(q[j], nj);
+		}
+	}
+}
+
+/*!
+\brief Compute the intensity at a point inside the box.
+\param p Point, relative to the center.
+\param noise Noises at the point, defined by NoiseScale and NoiseOffset.
+*/
+float TFloatingIsland::Potential(const Vector3& p, const float* noise) const
+{
+	float za, zb;
+	Elevation(p, noise, za, zb);
+
+	// Distance to terrain
+	float dta = za - p[1];
+	float dtb = zb - p[1];
+
+	// Radius blend
+	const float rb = 20.0f;
+
+	// Elevation field
+	float ea = Math::CubicSigmoid(-dta, rb, TTree::T()) + TTree::T();
+	float eb = Math::CubicSigmoid(dtb, rb, TTree::T()) + TTree::T();
+	float e = Math::Min(ea, eb);
+
+	// Box field
+	float f = 2.0f*TTree::T() * Math::CubicSmoothCompact(localbox.Distance(p), 0.25f*r*r);
+	return Math::Min(e, f);
+}
+
+/*!
+\brief Compute the elevations of the bottom and of the top of the island.
+\param p Point, relative to the center.
+\param noise Noises at the point, defined by NoiseScale and NoiseOffset.
+\param za, zb Returned bottom and top elevations.
+*/
+void TFloatingIsland::Elevation(const Vector3& p, const float* noise, float& za, float& zb) const
+{
 	// Main smoothing function
 	float t = 1.0f - SmoothDisc2D(Vector2(0.0f), r / 2.0f, r).Intensity(Vector2(p));
 
-	float za = -depth + depth / 2.0f*(1.0f - t)*PerlinNoise::GetValue(p / 30.0f + 0.54f) + depth / 4.0f*(1.0f - t)*PerlinNoise::GetValue(p / 14.0f + .63f) + depth / 8.0f*PerlinNoise::GetValue(p / 7.0f + .13f) + depth / 16.0f*PerlinNoise::GetValue(p / 4.0f + .79f) + depth / 32.0f*PerlinNoise::GetValue(p / 2.0f + .79f);
-	float zb = height / 2.0f + height / 4.0f*(1.0f - t)*PerlinNoise::GetValue(p / 89.0f) + height / 8.0f*PerlinNoise::GetValue(p / 46.0f) + 3 * PerlinNoise::GetValue(p / 14.0f);
+	za = -depth + depth / 2.0f*(1.0f - t)*noise[0] + depth / 4.0f*(1.0f - t)*noise[1] + depth / 8.0f*noise[2] + depth / 16.0f*noise[3] + depth / 32.0f*noise[4];
+	zb = height / 2.0f + height / 4.0f*(1.0f - t)*noise[5] + height / 8.0f*noise[6] + 3 * noise[7];
 
 	// Big pikes inside
 	za -= 10.0f*SmoothDisc2D(Vector2(-r / 4.0f, r / 8.0f), 0.0f, r / 2.0f).Intensity(Vector2(p));
@@ -87,6 +214,80 @@ float TFloatingIsland::Intensity(const Vector3& q) const
 
 	za = 10.0f*t + (1 - t)*za;
 	zb = -20.0f*t + (1 - t)*zb;
+}
+
+/*!
+\brief Compute the elevations of the bottom and of the top of the island, and their gradients.
+The noises are differentiated analytically.
+\param p Point, relative to the center.
+\param za, zb Returned bottom and top elevations.
+\param ga, gb Returned gradients.
+*/
+void TFloatingIsland::Elevation(const Vector3& p, float& za, float& zb, Vector3& ga, Vector3& gb) const
+{
+	float noise[8];
+	Vector3 d[8];
+	for (int i = 0; i < 8; i++)
+	{
+		noise[i] = PerlinNoise::GetValueAndDerivative(p / NoiseScale[i] + NoiseOffset[i], d[i]);
+		d[i] = d[i] / NoiseScale[i];
+	}
+
+	// Main smoothing function
+	Vector2 h;
+	float t = 1.0f - SmoothDisc2D(Vector2(0.0f), r / 2.0f, r).Intensity(Vector2(p), h);
+	Vector3 gt = Vector3(-h[0], 0.0f, -h[1]);
+
+	za = -depth + depth / 2.0f*(1.0f - t)*noise[0] + depth / 4.0f*(1.0f - t)*noise[1] + depth / 8.0f*noise[2] + depth / 16.0f*noise[3] + depth / 32.0f*noise[4];
+	zb = height / 2.0f + height / 4.0f*(1.0f - t)*noise[5] + height / 8.0f*noise[6] + 3 * noise[7];
+	ga = (d[0] * (depth / 2.0f) + d[1] * (depth / 4.0f)) * (1.0f - t) - gt * (depth / 2.0f * noise[0] + depth / 4.0f * noise[1]) + d[2] * (depth / 8.0f) + d[3] * (depth / 16.0f) + d[4] * (depth / 32.0f);
+	gb = d[5] * (height / 4.0f * (1.0f - t)) - gt * (height / 4.0f * noise[5]) + d[6] * (height / 8.0f) + d[7] * 3.0f;
+
+	// Big pikes inside
+	za -= 10.0f*SmoothDisc2D(Vector2(-r / 4.0f, r / 8.0f), 0.0f, r / 2.0f).Intensity(Vector2(p), h);
+	ga = ga - Vector3(h[0], 0.0f, h[1]) * 10.0f;
+	za -= 8.0f*SmoothDisc2D(Vector2(r / 2.0f, r / 4.0f), 0.0f, r / 2.0f).Intensity(Vector2(p), h);
+	ga = ga - Vector3(h[0], 0.0f, h[1]) * 8.0f;
+	za -= 12.0f*SmoothDisc2D(Vector2(r / 8.0f, -r / 8.0f), 0.0f, r).Intensity(Vector2(p), h);
+	ga = ga - Vector3(h[0], 0.0f, h[1]) * 12.0f;
+
+	ga = gt * (10.0f - za) + ga * (1 - t);
+	gb = gt * (-20.0f - zb) + gb * (1 - t);
+	za = 10.0f*t + (1 - t)*za;
+	zb = -20.0f*t + (1 - t)*zb;
+}
+
+/*!
+\brief Compute the gradient at a given point.
+The intensity is the minimum of the bottom, top and box fields, so the gradient is the one of the smallest field.
+\param q Point.
+*/
+Vector3 TFloatingIsland::Gradient(const Vector3& q) const
+{
+	float v;
+	Vector3 g;
+	IntensityGradient(q, v, g);
+	return g;
+}
+
+/*!
+\brief Compute the intensity and the gradient at a given point, evaluating the elevations once.
+\param q Point.
+\param v Returned intensity.
+\param g Returned gradient.
+*/
+void TFloatingIsland::IntensityGradient(const Vector3& q, float& v, Vector3& g) const
+{
+	Vector3 p = q - c;
+
+	v = 0.0f;
+	g = Vector3(0.0f);
+	if (!box.Contains(p))
+		return;
+
+	float za, zb;
+	Vector3 ga, gb;
+	Elevation(p, za, zb, ga, gb);
 
 	// Distance to terrain
 	float dta = za - p[1];
@@ -95,14 +296,94 @@ float TFloatingIsland::Intensity(const Vector3& q) const
 	// Radius blend
 	const float rb = 20.0f;
 
-	// Elevation field
+	// Elevation and box fields
 	float ea = Math::CubicSigmoid(-dta, rb, TTree::T()) + TTree::T();
 	float eb = Math::CubicSigmoid(dtb, rb, TTree::T()) + TTree::T();
-	float e = Math::Min(ea, eb);
+	float d = localbox.Distance(p);
+	float f = 2.0f*TTree::T() * Math::CubicSmoothCompact(d, 0.25f*r*r);
+	v = Math::Min(Math::Min(ea, eb), f);
+	if (f < Math::Min(ea, eb))
+	{
+		g = localbox.DistanceGradient(p) * (2.0f*TTree::T() * Math::CubicSmoothCompactDerivative(d, 0.25f*r*r));
+		return;
+	}
+
+	// Gradient of the elevation defining the smallest field
+	const bool bottom = ea <= eb;
+	g = bottom ? ga : gb;
+	g[1] -= 1.0f;
+	g = g * (bottom ? -Math::CubicSigmoidDerivative(-dta, rb, TTree::T()) : Math::CubicSigmoidDerivative(dtb, rb, TTree::T()));
+}
+
+/*!
+\brief Compute the intensity range in a box, following Potential() with intervals.
+The bottom and top elevations are bounded over the part of the box lying inside the primitive box,
+the intensity being null elsewhere, the noises being bounded with PerlinNoise::GetRange().
+The elevation fields are monotonic with the elevations and the ordinate, and the box field decreases
+with the distance to the local box.
+\param b Box.
+*/
+Vector2 TFloatingIsland::Range(const Box& b) const
+{
+	const Box l(b[0] - c, b[1] - c);
+	if (!box.Intersect(l))
+		return Vector2(0.0f);
+	const Box inside(Vector3::Max(l[0], box[0]), Vector3::Min(l[1], box[1]));
+	const Box2D domain(inside);
+	const Vector3 m = (inside[0] + inside[1]) / 2.0f;
+	const float radius = Magnitude(inside[1] - inside[0]) / 2.0f;
+	Vector2 noise[8];
+	for (int i = 0; i < 8; i++)
+		noise[i] = PerlinNoise::GetRange(m / NoiseScale[i] + NoiseOffset[i], radius / NoiseScale[i]);
+
+	// Main smoothing function, s = 1 - t
+	const Vector2 s = SmoothDisc2D(Vector2(0.0f), r / 2.0f, r).Range(domain);
+
+	Vector2 za = IntervalProduct(s, noise[0] * (depth / 2.0f) + noise[1] * (depth / 4.0f)) + noise[2] * (depth / 8.0f) + noise[3] * (depth / 16.0f) + noise[4] * (depth / 32.0f) - depth;
+	Vector2 zb = IntervalProduct(s, noise[5] * (height / 4.0f)) + noise[6] * (height / 8.0f) + noise[7] * 3.0f + height / 2.0f;
+
+	// Big pikes inside, lowering the bottom
+	const Vector2 pikes = SmoothDisc2D(Vector2(-r / 4.0f, r / 8.0f), 0.0f, r / 2.0f).Range(domain) * 10.0f
+		+ SmoothDisc2D(Vector2(r / 2.0f, r / 4.0f), 0.0f, r / 2.0f).Range(domain) * 8.0f
+		+ SmoothDisc2D(Vector2(r / 8.0f, -r / 8.0f), 0.0f, r).Range(domain) * 12.0f;
+	za = za - Vector2(pikes[1], pikes[0]);
+
+	za = IntervalProduct(s, za - 10.0f) + 10.0f;
+	zb = IntervalProduct(s, zb + 20.0f) - 20.0f;
+
+	// Elevation fields
+	const float rb = 20.0f;
+	float ea = Math::Min(Math::CubicSigmoid(inside[0][1] - za[1], rb, TTree::T()), Math::CubicSigmoid(zb[0] - inside[1][1], rb, TTree::T())) + TTree::T();
+	float eb = Math::Min(Math::CubicSigmoid(inside[1][1] - za[0], rb, TTree::T()), Math::CubicSigmoid(zb[1] - inside[0][1], rb, TTree::T())) + TTree::T();
 
 	// Box field
-	float f = 2.0f*TTree::T() * Math::CubicSmoothCompact(localbox.Distance(p), 0.25f*r*r);
-	return Math::Min(e, f);
+	float d = 0.0f;
+	for (int i = 0; i < 8; i++)
+		d = Math::Max(d, localbox.Distance(inside.Corner(i)));
+	float fa = 2.0f * TTree::T() * Math::CubicSmoothCompact(d, 0.25f * r * r);
+	float fb = 2.0f * TTree::T() * Math::CubicSmoothCompact(localbox.Distance(inside), 0.25f * r * r);
+
+	// Points of the box lying outside of the primitive box have a null intensity
+	float a = Math::Min(ea, fa);
+	if (!(l[0] > box[0] && l[1] < box[1]))
+		a = 0.0f;
+	return Vector2(a, Math::Min(eb, fb));
+}
+
+/*!
+\brief The box is expressed relative to the center, so it does not bound the island.
+*/
+bool TFloatingIsland::Bounded() const
+{
+	return false;
+}
+
+/*!
+\brief Returns the relative cost of the evaluation, dominated by the noise of both elevations.
+*/
+float TFloatingIsland::Cost() const
+{
+	return 160.0f;
 }
 
 
@@ -162,3 +443,75 @@ float TFloatingIsland2::Intensity(const Vector3& q) const
 	float f = 2.0f*TTree::T() * Math::CubicSmoothCompact(localbox.Distance(p), rb);
 	return Math::Min(e, f);
 }
+
+/*!
+\copydoc TFloatingIsland::Intensity(const Vector3*, float*, int) const
+*/
+void TFloatingIsland2::Intensity(const Vector3* p, float* v, int n) const
+{
+	for (int k = 0; k < n; k += PacketSize)
+	{
+		const int m = Math::Min(n - k, PacketSize);
+		const Box packet(p + k, m);
+		const bool cull = !box.Intersect(Box(packet[0] - c, packet[1] - c));
+		for (int i = k; i < k + m; i++)
+			v[i] = cull ? 0.0f : Intensity(p[i]);
+	}
+}
+
+/*!
+\brief Compute the intensity range in a box, following Intensity() with intervals as TFloatingIsland::Range().
+\param b Box.
+*/
+Vector2 TFloatingIsland2::Range(const Box& b) const
+{
+	const Box l(b[0] - c, b[1] - c);
+	if (!box.Intersect(l))
+		return Vector2(0.0f);
+	const Box inside(Vector3::Max(l[0], box[0]), Vector3::Min(l[1], box[1]));
+	const Box2D domain(inside);
+
+	// Main smoothing function, s = 1 - t
+	const Vector2 s = SmoothDisc2D(Vector2(0.0f), r / 2.0f, r).Range(domain);
+
+	// Big pikes inside, and crossing
+	const Vector2 pikes = SmoothDisc2D(Vector2(-r / 4.0f, r / 8.0f), 0.0f, r / 2.0f).Range(domain) * 10.0f
+		+ SmoothDisc2D(Vector2(r / 2.0f, r / 4.0f), 0.0f, r / 2.0f).Range(domain) * 8.0f
+		+ SmoothDisc2D(Vector2(r / 8.0f, -r / 8.0f), 0.0f, r).Range(domain) * 12.0f;
+	const Vector2 za = Vector2(-pikes[1] - 10.0f * s[1], -pikes[0] - 10.0f * s[0]) + 10.0f;
+	const Vector2 zb = s * 15.0f - 15.0f;
+
+	// Elevation fields
+	const float rb = 20.0f;
+	float ea = Math::Min(Math::CubicSigmoid(inside[0][1] - za[1], rb, TTree::T()), Math::CubicSigmoid(zb[0] - inside[1][1], rb, TTree::T())) + TTree::T();
+	float eb = Math::Min(Math::CubicSigmoid(inside[1][1] - za[0], rb, TTree::T()), Math::CubicSigmoid(zb[1] - inside[0][1], rb, TTree::T())) + TTree::T();
+
+	// Box field
+	float d = 0.0f;
+	for (int i = 0; i < 8; i++)
+		d = Math::Max(d, localbox.Distance(inside.Corner(i)));
+	float fa = 2.0f * TTree::T() * Math::CubicSmoothCompact(d, rb);
+	float fb = 2.0f * TTree::T() * Math::CubicSmoothCompact(localbox.Distance(inside), rb);
+
+	// Points of the box lying outside of the primitive box have a null intensity
+	float a = Math::Min(ea, fa);
+	if (!(l[0] > box[0] && l[1] < box[1]))
+		a = 0.0f;
+	return Vector2(a, Math::Min(eb, fb));
+}
+
+/*!
+\copydoc TFloatingIsland::Bounded
+*/
+bool TFloatingIsland2::Bounded() const
+{
+	return false;
+}
+
+/*!
+\copydoc TFloatingIsland::Cost
+*/
+float TFloatingIsland2::Cost() const
+{
+	return 115.0f;
+}
@@ -0,0 +1,264 @@
+#include "ttree.h"
+
+/*!
+\class THeightField ttree.h
+\brief Terrain node defined by a grid of elevations, such as a digital elevation model.
+
+The elevations are stored in memory, or mapped from a tiled file. They are interpolated bilinearly or bicubically.
+The minimum and maximum elevations of tiles of the grid are precomputed and merged into a quadtree, so that
+the box of the node and the ranges of the intensity are tight, and that empty regions are skipped quickly.
+*/
+
+// Fraction of the range of the samples by which a bicubic Catmull-Rom patch may overshoot them
+static const float Overshoot = 0.28125f;
+
+/*!
+\brief Catmull-Rom interpolation between b and c.
+\param a, b, c, d Samples.
+\param t Interpolant.
+*/
+static inline float CatmullRom(float a, float b, float c, float d, float t)
+{
+	return b + 0.5f * t * (c - a + t * (2.0f * a - 5.0f * b + 4.0f * c - d + t * (3.0f * (b - c) + d - a)));
+}
+
+/*!
+\brief Create a heightfield node.
+\param hf Elevations, copied by the node.
+\param r Radius of influence of the terrain.
+\param bicubic Bicubic interpolation, bilinear otherwise.
+*/
+THeightField::THeightField(const HeightField& hf, float r, bool bicubic) : TTerrainNode(Box2D(hf.BottomLeft(), hf.TopRight()).ToBox(0.0f, 0.0f), r, r), field(hf), tiled(nullptr), nx(hf.SizeX()), ny(hf.SizeY()), bicubic(bicubic)
+{
+	Initialize(hf.BottomLeft(), hf.TopRight(), r);
+}
+
+/*!
+\brief Create a heightfield node from elevations mapped from a file.
+\param hf Elevations, which should outlive the node.
+\param r Radius of influence of the terrain.
+\param bicubic Bicubic interpolation, bilinear otherwise.
+*/
+THeightField::THeightField(const TiledHeightField& hf, float r, bool bicubic) : TTerrainNode(Box2D(hf.BottomLeft(), hf.TopRight()).ToBox(0.0f, 0.0f), r, r), tiled(&hf), nx(hf.SizeX()), ny(hf.SizeY()), bicubic(bicubic)
+{
+	Initialize(hf.BottomLeft(), hf.TopRight(), r);
+}
+
+/*!
+\brief Get an elevation of the grid.
+\param i, j Row and column.
+*/
+inline float THeightField::Sample(int i, int j) const
+{
+	return tiled != nullptr ? tiled->Get(i, j) : field.Get(i, j);
+}
+
+/*!
+\brief Compute the minimum and maximum elevations of the tiles, and the box of the node.
+\param bl, tr Corners of the grid.
+\param r Radius of influence of the terrain.
+*/
+void THeightField::Initialize(const Vector2& bl, const Vector2& tr, float r)
+{
+	a = bl;
+	cell = tr - bl;
+	cell[0] /= float(nx - 1);
+	cell[1] /= float(ny - 1);
+
+	// Samples influencing the cells of each tile, with their neighbors for bicubic patches
+	tx = (nx - 2) / TileSize + 1;
+	ty = (ny - 2) / TileSize + 1;
+	tiles.assign(1, std::vector<Vector2>(tx * ty));
+	const int ring = bicubic ? 1 : 0;
+#pragma omp parallel for
+	for (int v = 0; v < ty; v++)
+	{
+		for (int u = 0; u < tx; u++)
+		{
+			const int i0 = Math::Max(v * TileSize - ring, 0), i1 = Math::Min((v + 1) * TileSize + ring, ny - 1);
+			const int j0 = Math::Max(u * TileSize - ring, 0), j1 = Math::Min((u + 1) * TileSize + ring, nx - 1);
+			float zmin = Sample(i0, j0);
+			float zmax = zmin;
+			for (int i = i0; i <= i1; i++)
+			{
+				for (int j = j0; j <= j1; j++)
+				{
+					zmin = Math::Min(zmin, Sample(i, j));
+					zmax = Math::Max(zmax, Sample(i, j));
+				}
+			}
+			const float e = bicubic ? Overshoot * (zmax - zmin) : 0.0f;
+			tiles[0][v * tx + u] = Vector2(zmin - e, zmax + e);
+		}
+	}
+
+	// Quadtree, level l having nodes of 2^l x 2^l tiles
+	for (int l = 1; ((tx - 1) >> (l - 1)) > 0 || ((ty - 1) >> (l - 1)) > 0; l++)
+	{
+		const int sx = ((tx - 1) >> l) + 1, sy = ((ty - 1) >> l) + 1;
+		const int cx = ((tx - 1) >> (l - 1)) + 1, cy = ((ty - 1) >> (l - 1)) + 1;
+		const std::vector<Vector2>& children = tiles[l - 1];
+		std::vector<Vector2> level(sx * sy);
+		for (int v = 0; v < sy; v++)
+		{
+			for (int u = 0; u < sx; u++)
+			{
+				Vector2 z = children[2 * v * cx + 2 * u];
+				for (int k = 1; k < 4; k++)
+				{
+					const int cu = 2 * u + (k & 1), cv = 2 * v + (k >> 1);
+					if (cu < cx && cv < cy)
+						z = Vector2(Math::Min(z[0], children[cv * cx + cu][0]), Math::Max(z[1], children[cv * cx + cu][1]));
+				}
+				level[v * sx + u] = z;
+			}
+		}
+		tiles.push_back(level);
+	}
+
+	// Tight box
+	const Vector2 z = tiles.back()[0];
+	box = Box2D(bl, tr).ToBox(z[0], z[1]).Extended(Vector3(0.0, r, 0.0));
+	localbox = box.Extended(Vector3(-0.5f * r));
+}
+
+/*!
+\copydoc TTerrainNode::Height
+\param p Point, clamped to the grid.
+*/
+float THeightField::Height(const Vector2& p) const
+{
+	const float u = Math::Clamp((p[0] - a[0]) / cell[0], 0.0f, float(nx - 1));
+	const float v = Math::Clamp((p[1] - a[1]) / cell[1], 0.0f, float(ny - 1));
+	const int j = Math::Min(int(u), nx - 2);
+	const int i = Math::Min(int(v), ny - 2);
+	const float s = u - j;
+	const float t = v - i;
+
+	if (!bicubic)
+		return Math::Lerp(Math::Lerp(Sample(i, j), Sample(i, j + 1), s), Math::Lerp(Sample(i + 1, j), Sample(i + 1, j + 1), s), t);
+
+	// Catmull-Rom patch, clamping the samples to the grid
+	const int ja = Math::Max(j - 1, 0), jd = Math::Min(j + 2, nx - 1);
+	float z[4];
+	for (int k = 0; k < 4; k++)
+	{
+		const int row = Math::Min(Math::Max(i - 1 + k, 0), ny - 1);
+		z[k] = CatmullRom(Sample(row, ja), Sample(row, j), Sample(row, j + 1), Sample(row, jd), s);
+	}
+	return CatmullRom(z[0], z[1], z[2], z[3], t);
+}
+
+/*!
+\brief Compute the range of tiles overlapped by a domain, clamped to the grid.
+\param b Domain.
+\param t Returned first and last tiles along x and y.
+*/
+void THeightField::Tiles(const Box2D& b, int t[4]) const
+{
+	t[0] = Math::Min(Math::Max(int(floor((b[0][0] - a[0]) / cell[0])), 0), nx - 2) / TileSize;
+	t[1] = Math::Min(Math::Max(int(floor((b[1][0] - a[0]) / cell[0])), 0), nx - 2) / TileSize;
+	t[2] = Math::Min(Math::Max(int(floor((b[0][1] - a[1]) / cell[1])), 0), ny - 2) / TileSize;
+	t[3] = Math::Min(Math::Max(int(floor((b[1][1] - a[1]) / cell[1])), 0), ny - 2) / TileSize;
+}
+
+/*!
+\brief Compute the minimum and maximum elevation over a domain from the tiles it overlaps.
+The quadtree is traversed from the root, nodes lying inside the domain or within the current range being not refined.
+\param b Domain.
+*/
+Vector2 THeightField::HeightRange(const Box2D& b) const
+{
+	int t[4];
+	Tiles(b, t);
+	Vector2 z = tiles[0][t[2] * tx + t[0]];
+	HeightRange(int(tiles.size()) - 1, 0, 0, t, z);
+	return z;
+}
+
+/*!
+\brief Extend a range of elevations with the tiles of a node of the quadtree overlapping a range of tiles.
+\param l Level of the node.
+\param u, v Coordinates of the node.
+\param t Range of tiles.
+\param z Range of elevations.
+*/
+void THeightField::HeightRange(int l, int u, int v, const int t[4], Vector2& z) const
+{
+	const int u0 = u << l, u1 = ((u + 1) << l) - 1;
+	const int v0 = v << l, v1 = ((v + 1) << l) - 1;
+	if (u1 < t[0] || u0 > t[1] || v1 < t[2] || v0 > t[3])
+		return;
+
+	const Vector2& n = tiles[l][v * (((tx - 1) >> l) + 1) + u];
+	if (n[0] >= z[0] && n[1] <= z[1])
+		return;
+	if (l == 0 || (u0 >= t[0] && u1 <= t[1] && v0 >= t[2] && v1 <= t[3]))
+	{
+		z = Vector2(Math::Min(z[0], n[0]), Math::Max(z[1], n[1]));
+		return;
+	}
+
+	const int sx = ((tx - 1) >> (l - 1)) + 1, sy = ((ty - 1) >> (l - 1)) + 1;
+	for (int k = 0; k < 4; k++)
+	{
+		const int cu = 2 * u + (k & 1), cv = 2 * v + (k >> 1);
+		if (cu < sx && cv < sy)
+			HeightRange(l - 1, cu, cv, t, z);
+	}
+}
+
+/*!
+\brief Check whether the surface may cross a box.
+Inside the local box, the surface is the terrain: the elevation over one of the tiles overlapped by the box should lie in
+its vertical range, so that regions far above or below the terrain are skipped. Elsewhere, the range of the intensity is checked.
+\param b Box.
+*/
+bool THeightField::Intersect(const Box& b) const
+{
+	if (!box.Intersect(b))
+		return false;
+	if (!localbox.Contains(b[0]) || !localbox.Contains(b[1]))
+		return TTerrainNode::Intersect(b);
+	int t[4];
+	Tiles(Box2D(b), t);
+	return Intersect(int(tiles.size()) - 1, 0, 0, t, Vector2(b[0][1] - Tolerance(), b[1][1] + Tolerance()));
+}
+
+/*!
+\brief Check whether the elevation over one of the tiles of a node of the quadtree overlapping a range of tiles may lie in an interval.
+\param l Level of the node.
+\param u, v Coordinates of the node.
+\param t Range of tiles.
+\param y Interval.
+*/
+bool THeightField::Intersect(int l, int u, int v, const int t[4], const Vector2& y) const
+{
+	const int u0 = u << l, u1 = ((u + 1) << l) - 1;
+	const int v0 = v << l, v1 = ((v + 1) << l) - 1;
+	if (u1 < t[0] || u0 > t[1] || v1 < t[2] || v0 > t[3])
+		return false;
+
+	const Vector2& n = tiles[l][v * (((tx - 1) >> l) + 1) + u];
+	if (n[1] < y[0] || n[0] > y[1])
+		return false;
+	if (l == 0)
+		return true;
+
+	const int sx = ((tx - 1) >> (l - 1)) + 1, sy = ((ty - 1) >> (l - 1)) + 1;
+	for (int k = 0; k < 4; k++)
+	{
+		const int cu = 2 * u + (k & 1), cv = 2 * v + (k >> 1);
+		if (cu < sx && cv < sy && Intersect(l - 1, cu, cv, t, y))
+			return true;
+	}
+	return false;
+}
+
+/*!
+\brief Returns the relative cost of the evaluation, which depends on the interpolation.
+*/
+float THeightField::Cost() const
+{
+	return bicubic ? 7.0f : 5.0f;
+}
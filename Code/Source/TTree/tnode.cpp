@@ -1,5 +1,7 @@
 #include "ttree.h"
 
+#include <limits>
+
 /*!
 \class TNode ttree.h
 \brief Base node class.
@@ -40,6 +42,47 @@ float TNode::Intensity(const Vector3& p) const
 	return 0.0;
 }
 
+/*!
+\brief Compute the intensity at a set of points.
+
+Points are processed by packets: packets lying outside of the box are skipped altogether,
+otherwise the intensity is evaluated point by point.
+\param p Points.
+\param v Returned intensities.
+\param n Number of points.
+*/
+void TNode::Intensity(const Vector3* p, float* v, int n) const
+{
+	const Box b = GetBox();
+	for (int k = 0; k < n; k += PacketSize)
+	{
+		const int m = Math::Min(n - k, PacketSize);
+		const bool cull = !b.Intersect(Box(p + k, m));
+		for (int i = k; i < k + m; i++)
+			v[i] = cull ? 0.0f : Intensity(p[i]);
+	}
+}
+
+/*!
+\brief Compute the intensity along a vertical column.
+By default, the points of the column are evaluated by packets.
+\param p Horizontal coordinates of the column.
+\param y Ordinates of the points.
+\param v Returned intensities.
+\param n Number of points.
+*/
+void TNode::Intensity(const Vector2& p, const float* y, float* v, int n) const
+{
+	Vector3 q[PacketSize];
+	for (int k = 0; k < n; k += PacketSize)
+	{
+		const int m = Math::Min(n - k, PacketSize);
+		for (int i = 0; i < m; i++)
+			q[i] = p.ToVector3(y[k + i]);
+		Intensity(q, v + k, m);
+	}
+}
+
 /*!
 \brief Compute the gradient at a given point.
 \param p Point.
@@ -54,6 +97,44 @@ Vector3 TNode::Gradient(const Vector3& p) const
 	return Vector3(x, y, z) / (2.0f * Epsilon);
 }
 
+/*!
+\brief Compute the intensity and the gradient at a given point.
+Nodes whose gradient depends on their intensity should compute both in a single pass.
+\param p Point.
+\param v Returned intensity.
+\param g Returned gradient.
+*/
+void TNode::IntensityGradient(const Vector3& p, float& v, Vector3& g) const
+{
+	v = Intensity(p);
+	g = Gradient(p);
+}
+
+/*!
+\brief Compute a conservative interval containing the intensity of every point of a box.
+
+The generic node only knows that its field vanishes outside of its bounding box.
+\param b Box.
+\return Minimum and maximum intensity.
+*/
+Vector2 TNode::Range(const Box& b) const
+{
+	if (!GetBox().Intersect(b))
+		return Vector2(0.0f);
+	return Vector2(-std::numeric_limits<float>::max(), std::numeric_limits<float>::max());
+}
+
+/*!
+\brief Check whether the surface of the node, where its intensity reaches the threshold, may cross a box.
+By default, the range of the intensity over the box should contain the threshold.
+\param b Box.
+*/
+bool TNode::Intersect(const Box& b) const
+{
+	const Vector2 r = Range(b);
+	return r[0] <= TTree::T() && r[1] >= TTree::T();
+}
+
 /*!
 \brief Returns the bounding box of the node.
 */
@@ -61,3 +142,82 @@ Box TNode::GetBox() const
 {
 	return box;
 }
+
+/*!
+\brief Check whether the intensity vanishes outside of the bounding box, so that parents may cull the node with it.
+
+Generic nodes are expected to, see Range().
+*/
+bool TNode::Bounded() const
+{
+	return true;
+}
+
+/*!
+\brief Returns the relative cost of the evaluation of the intensity, a vertex costing 1.
+
+Used to weight the nodes when building a bounding volume hierarchy.
+*/
+float TNode::Cost() const
+{
+	return 1.0f;
+}
+
+/*!
+\brief Allocate a node from the arena of the current thread, see TArena::Scope, or on the heap.
+
+Every node is preceded by the arena it belongs to, so that it is returned where it was allocated.
+\param size Size of the node.
+*/
+void* TNode::operator new(size_t size)
+{
+	TArena* arena = TArena::Current();
+	char* p = static_cast<char*>(arena != nullptr ? arena->Allocate(size + TArena::Alignment) : ::operator new(size + TArena::Alignment));
+	*reinterpret_cast<TArena**>(p) = arena;
+	return p + TArena::Alignment;
+}
+
+/*!
+\brief Return the memory of a node to its arena, or to the heap.
+\param p Node.
+\param size Size of the node.
+*/
+void TNode::operator delete(void* p, size_t size)
+{
+	char* q = static_cast<char*>(p) - TArena::Alignment;
+	TArena* arena = *reinterpret_cast<TArena**>(q);
+	if (arena != nullptr)
+		arena->Free(q, size + TArena::Alignment);
+	else
+		::operator delete(q);
+}
+
+/*!
+\brief Delete a tree with an explicit stack, so that deep trees do not overflow the call stack.
+
+Sub-trees are detached from every node before it is deleted, so that destructors do not recurse.
+\param node Root, may be null.
+*/
+void TNode::Delete(TNode* node)
+{
+	if (node == nullptr)
+		return;
+	std::vector<TNode*> stack = { node };
+	while (!stack.empty())
+	{
+		TNode* n = stack.back();
+		stack.pop_back();
+		n->Detach(stack);
+		delete n;
+	}
+}
+
+/*!
+\brief Move the sub-trees owned by the node to a stack, leaving the node without sub-trees.
+
+Leaves own no sub-tree.
+\param stack Stack.
+*/
+void TNode::Detach(std::vector<TNode*>&)
+{
+}
@@ -0,0 +1,120 @@
+#include "ttree.h"
+
+/*!
+\class TSegment ttree.h
+\brief A segment skeleton primitive, whose field is the cubic falloff of the squared distance to the segment.
+*/
+
+/*!
+\brief Constructor.
+\param a, b End vertices.
+\param r Radius
+\param e Intensity.
+*/
+TSegment::TSegment(const Vector3& a, const Vector3& b, float r, float e) : TCubicFalloff(r, e), a(a), u(b - a)
+{
+	const float uu = SquaredMagnitude(u);
+	k = uu > 0.0f ? 1.0f / uu : 0.0f;
+	box = Box(Box(a, r), Box(b, r));
+}
+
+/*!
+\brief Compute the vector from the closest point of the segment to a given point.
+Its squared magnitude is the squared distance to the segment, and twice the vector is the gradient of the latter.
+\param p Point.
+*/
+inline Vector3 TSegment::Offset(const Vector3& p) const
+{
+	const Vector3 ap = p - a;
+	const float t = Math::Clamp(Dot(ap, u) * k, 0.0f, 1.0f);
+	return ap - u * t;
+}
+
+/*!
+\brief Compute the intensity at a given point.
+\param p Point.
+*/
+float TSegment::Intensity(const Vector3& p) const
+{
+	if (!box.Contains(p))
+		return 0.0f;
+	return Falloff(SquaredMagnitude(Offset(p)));
+}
+
+/*!
+\brief Compute the intensity at a set of points, skipping packets lying outside of the box.
+\param p Points.
+\param v Returned intensities.
+\param n Number of points.
+*/
+void TSegment::Intensity(const Vector3* p, float* v, int n) const
+{
+	for (int k = 0; k < n; k += PacketSize)
+	{
+		const int m = Math::Min(n - k, PacketSize);
+		const bool cull = !box.Intersect(Box(p + k, m));
+		for (int i = k; i < k + m; i++)
+			v[i] = (cull || !box.Contains(p[i])) ? 0.0f : Falloff(SquaredMagnitude(Offset(p[i])));
+	}
+}
+
+/*!
+\brief Compute the gradient at a given point, defined as the derivative of the cubic falloff.
+\param p Point.
+*/
+Vector3 TSegment::Gradient(const Vector3& p) const
+{
+	float v;
+	Vector3 g;
+	IntensityGradient(p, v, g);
+	return g;
+}
+
+/*!
+\brief Compute the intensity and the gradient at a given point.
+\param p Point.
+\param v Returned intensity.
+\param g Returned gradient.
+*/
+void TSegment::IntensityGradient(const Vector3& p, float& v, Vector3& g) const
+{
+	if (!box.Contains(p))
+	{
+		v = 0.0f;
+		g = Vector3(0.0f);
+		return;
+	}
+	const Vector3 d = Offset(p);
+	const float dd = SquaredMagnitude(d);
+	v = Falloff(dd);
+	g = d * (2.0f * e * Math::CubicSmoothCompactDerivative(dd, r * r));
+}
+
+/*!
+\brief Compute the intensity range in a box.
+The squared distance to the segment is convex, so that its maximum is reached at a corner of the box,
+and it is bounded from below by the distance between the box and the box of the segment.
+\param b Box.
+*/
+Vector2 TSegment::Range(const Box& b) const
+{
+	if (!box.Intersect(b))
+		return Vector2(0.0f);
+	float d = 0.0f;
+	for (int i = 0; i < 8; i++)
+		d = Math::Max(d, SquaredMagnitude(Offset(b.Corner(i))));
+	const Vector3 c = a + u;
+	float vn = Falloff(b.Distance(Box(Vector3::Min(a, c), Vector3::Max(a, c))));
+	float vf = Falloff(d);
+
+	// Points of the box lying outside of the primitive box have a null intensity
+	return Vector2(Math::Min(0.0f, Math::Min(vn, vf)), Math::Max(0.0f, Math::Max(vn, vf)));
+}
+
+/*!
+\brief Returns the relative cost of the evaluation, slightly more than a vertex.
+*/
+float TSegment::Cost() const
+{
+	return 1.5f;
+}
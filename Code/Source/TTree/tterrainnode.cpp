@@ -1,5 +1,147 @@
 #include "ttree.h"
 
+#include <atomic>
+
+// Step of the finite differences of the elevation
+static const float HeightEpsilon = 1e-2f;
+
+// Elevations of a terrain node baked lazily into tiles, shared by the threads querying the node
+class TerrainCache
+{
+public:
+	static const int TileSize = 32;							//!< Number of cells along the side of a tile.
+
+	Box2D domain;											//!< Cached domain.
+	float cell;												//!< Cell size.
+	float tolerance;										//!< Maximum interpolation error of a tile.
+	size_t memory;											//!< Maximum memory used by the tiles, in bytes.
+	int nx, ny;												//!< Number of tiles.
+	std::vector<std::atomic<const ScalarField2D*>> tiles;	//!< Baked tiles, null until first queried.
+	std::atomic<size_t> used;								//!< Memory used by the tiles.
+
+	static const ScalarField2D Rejected;					//!< Marks tiles whose elevations are not cached.
+
+	TerrainCache(const Box2D&, float, float, size_t);
+	~TerrainCache();
+
+	const ScalarField2D* Tile(const TTerrainNode*, int, int);
+	const ScalarField2D* Bake(const TTerrainNode*, int, int) const;
+};
+
+const ScalarField2D TerrainCache::Rejected;
+
+/*!
+\brief Create an empty cache.
+\param domain Cached domain.
+\param cell Cell size.
+\param tolerance Maximum interpolation error.
+\param memory Maximum memory used by the tiles, in bytes.
+*/
+TerrainCache::TerrainCache(const Box2D& domain, float cell, float tolerance, size_t memory) : domain(domain), cell(cell), tolerance(tolerance), memory(memory), used(0)
+{
+	const Vector2 d = domain[1] - domain[0];
+	nx = int(d[0] / (cell * TileSize)) + 1;
+	ny = int(d[1] / (cell * TileSize)) + 1;
+	tiles = std::vector<std::atomic<const ScalarField2D*>>(nx * ny);
+	for (std::atomic<const ScalarField2D*>& t : tiles)
+		t.store(nullptr);
+}
+
+/*!
+\brief Release the tiles.
+*/
+TerrainCache::~TerrainCache()
+{
+	for (std::atomic<const ScalarField2D*>& t : tiles)
+	{
+		const ScalarField2D* tile = t.load();
+		if (tile != &Rejected)
+			delete tile;
+	}
+}
+
+/*!
+\brief Get a tile, baking it on first access.
+Tiles are not baked once their memory would exceed the cap, and concurrent bakes of the same tile keep the first result.
+\param node Terrain node.
+\param i, j Tile coordinates.
+*/
+const ScalarField2D* TerrainCache::Tile(const TTerrainNode* node, int i, int j)
+{
+	std::atomic<const ScalarField2D*>& t = tiles[j * nx + i];
+	const ScalarField2D* tile = t.load(std::memory_order_acquire);
+	if (tile != nullptr)
+		return tile;
+
+	// Reserve the memory of the tile before baking it, so that concurrent bakes cannot exceed the cap together.
+	// Beyond the cap the tile is not marked, and is baked by a later query if rejected bakes gave back their memory.
+	// Once the cap is reached, queries only read the counter instead of reserving and releasing memory.
+	const size_t size = (TileSize + 2) * (TileSize + 2) * sizeof(float);
+	if (used.load(std::memory_order_relaxed) + size > memory)
+		return &Rejected;
+	if (used.fetch_add(size, std::memory_order_relaxed) + size > memory)
+	{
+		used.fetch_sub(size, std::memory_order_relaxed);
+		return &Rejected;
+	}
+
+	const ScalarField2D* baked = Bake(node, i, j);
+	const bool stored = t.compare_exchange_strong(tile, baked, std::memory_order_acq_rel);
+	if (!stored || baked == &Rejected)
+		used.fetch_sub(size, std::memory_order_relaxed);
+	if (!stored)
+	{
+		if (baked != &Rejected)
+			delete baked;
+		return tile;
+	}
+	return baked;
+}
+
+/*!
+\brief Sample the elevations of a tile.
+Tiles carry an extra ring of samples so that bilinear lookups never fall on their upper edges.
+The interpolation error, null at the samples, is estimated at the centers of the cells and at the midpoints
+of their edges: tiles exceeding the tolerance are rejected.
+\param node Terrain node.
+\param i, j Tile coordinates.
+*/
+const ScalarField2D* TerrainCache::Bake(const TTerrainNode* node, int i, int j) const
+{
+	const int n = TileSize + 2;
+	const Vector2 a = domain[0] + Vector2(float(i), float(j)) * (cell * TileSize);
+	ScalarField2D* tile = new ScalarField2D(n, n, Box2D(a, a + Vector2(cell * (n - 1))));
+
+	std::vector<Vector2> p(n * n);
+	std::vector<float> z(n * n);
+	for (int y = 0; y < n; y++)
+		for (int x = 0; x < n; x++)
+			p[y * n + x] = a + Vector2(float(x), float(y)) * cell;
+	node->Height(p.data(), z.data(), n * n);
+	for (int y = 0; y < n; y++)
+		for (int x = 0; x < n; x++)
+			tile->Set(y, x, z[y * n + x]);
+
+	// Interpolation error on the lattice of half the cell size, samples excepted
+	int m = 0;
+	p.resize(TileSize * (3 * TileSize + 2));
+	z.resize(p.size());
+	for (int y = 0; y <= 2 * TileSize; y++)
+		for (int x = 0; x <= 2 * TileSize; x++)
+			if (x % 2 == 1 || y % 2 == 1)
+				p[m++] = a + Vector2(0.5f * x, 0.5f * y) * cell;
+	node->Height(p.data(), z.data(), m);
+	for (int k = 0; k < m; k++)
+	{
+		if (Math::Abs(tile->GetValueBilinear(p[k]) - z[k]) > tolerance)
+		{
+			delete tile;
+			return &Rejected;
+		}
+	}
+	return tile;
+}
+
 /*!
 \class TTerrainNode ttree.h
 \brief Base class for terrain primitives such as Heightfield and Noise primitives. This class is a generic elevation node.
@@ -10,10 +152,73 @@
 \param b The box.
 \param r Radius of influence of the terrain.
 */
-TTerrainNode::TTerrainNode(const Box& b, const float& X, const float& r) : TNode(b.Extended(Vector3(0.0, r, 0.0))), x(X), r(r), localbox(box.Extended(Vector3(-0.5f * r)))
+TTerrainNode::TTerrainNode(const Box& b, const float& X, const float& r) : TNode(b.Extended(Vector3(0.0, r, 0.0))), x(X), r(r), localbox(box.Extended(Vector3(-0.5f * r))), cache(nullptr)
 {
 }
 
+/*!
+\brief Destroy the node and its cache.
+*/
+TTerrainNode::~TTerrainNode()
+{
+	delete cache;
+}
+
+/*!
+\brief Cache the elevations of the node, which are then baked lazily into tiles and bilinearly interpolated.
+Tiles whose interpolation error exceeds the tolerance, and tiles beyond the memory cap, are evaluated with Height().
+Intensities are computed from the cached elevations whatever the query, only their gradients remain computed from Height().
+\param cell Cell size, no caching if null.
+\param tolerance Maximum interpolation error.
+\param memory Maximum memory used by the tiles, in bytes.
+*/
+void TTerrainNode::SetCache(float cell, float tolerance, size_t memory)
+{
+	delete cache;
+	cache = cell > 0.0f ? new TerrainCache(Box2D(box), cell, tolerance, memory) : nullptr;
+}
+
+/*!
+\brief Return a bound of the difference between the elevations used by the intensity and Height(), null without a cache.
+
+Baked tiles only check the tolerance at the centers and edge midpoints of their cells. Between those points the
+error of a cell whose curvature varies slowly exceeds the tolerance by at most a quarter, the bound allows twice the tolerance.
+*/
+float TTerrainNode::Tolerance() const
+{
+	return cache != nullptr ? 2.0f * cache->tolerance : 0.0f;
+}
+
+/*!
+\brief Compute the elevation, using the cache if any.
+\param p Point.
+*/
+float TTerrainNode::Elevation(const Vector2& p) const
+{
+	if (cache == nullptr || !cache->domain.Contains(p))
+		return Height(p);
+	const Vector2 q = (p - cache->domain[0]) / (cache->cell * TerrainCache::TileSize);
+	const ScalarField2D* tile = cache->Tile(this, int(q[0]), int(q[1]));
+	return tile == &TerrainCache::Rejected ? Height(p) : tile->GetValueBilinear(p);
+}
+
+/*!
+\brief Compute the elevation at a set of points, using the cache if any.
+\param p Points.
+\param h Returned elevations.
+\param n Number of points.
+*/
+void TTerrainNode::Elevation(const Vector2* p, float* h, int n) const
+{
+	if (cache == nullptr)
+	{
+		Height(p, h, n);
+		return;
+	}
+	for (int i = 0; i < n; i++)
+		h[i] = Elevation(p[i]);
+}
+
 /*!
 \brief Compute the elevation.
 \param p Point.
@@ -23,6 +228,51 @@ float TTerrainNode::Height(const Vector2& p) const
 	return 0.0;
 }
 
+/*!
+\brief Compute the elevation at a set of points.
+\param p Points.
+\param h Returned elevations.
+\param n Number of points.
+*/
+void TTerrainNode::Height(const Vector2* p, float* h, int n) const
+{
+	for (int i = 0; i < n; i++)
+		h[i] = Height(p[i]);
+}
+
+/*!
+\brief Compute the elevation and its gradient.
+By default, the gradient is computed with HeightGradient().
+\param p Point.
+\param g Returned gradient.
+*/
+float TTerrainNode::Height(const Vector2& p, Vector2& g) const
+{
+	g = HeightGradient(p);
+	return Height(p);
+}
+
+/*!
+\brief Compute the gradient of the elevation.
+By default, it is approximated with central differences.
+\param p Point.
+*/
+Vector2 TTerrainNode::HeightGradient(const Vector2& p) const
+{
+	float x = Height(Vector2(p[0] + HeightEpsilon, p[1])) - Height(Vector2(p[0] - HeightEpsilon, p[1]));
+	float y = Height(Vector2(p[0], p[1] + HeightEpsilon)) - Height(Vector2(p[0], p[1] - HeightEpsilon));
+	return Vector2(x, y) / (2.0f * HeightEpsilon);
+}
+
+/*!
+\brief Compute the minimum and maximum elevation over a domain.
+By default, the elevation is assumed to lie inside the box given to the constructor, whatever the domain.
+*/
+Vector2 TTerrainNode::HeightRange(const Box2D&) const
+{
+	return Vector2(box[0][1] + r, box[1][1] - r);
+}
+
 /*!
 \brief Compute the intensity.
 We first compute the elevation of the terrain, and then evaluate the distance to the terrain.
@@ -34,9 +284,75 @@ float TTerrainNode::Intensity(const Vector3& p) const
 {
 	if (!box.Contains(p))
 		return 0.0f;
+	return Potential(p, Elevation(Vector2(p)));
+}
+
+/*!
+\brief Compute the intensity at a set of points.
+Elevations of the points inside the box are computed together, with a single call to Elevation().
+\param p Points.
+\param v Returned intensities.
+\param n Number of points.
+*/
+void TTerrainNode::Intensity(const Vector3* p, float* v, int n) const
+{
+	Vector2 q[PacketSize];
+	float z[PacketSize];
+	int index[PacketSize];
+	for (int k = 0; k < n; k += PacketSize)
+	{
+		const int m = Math::Min(n - k, PacketSize);
+		const bool cull = !box.Intersect(Box(p + k, m));
+		int l = 0;
+		for (int i = k; i < k + m; i++)
+		{
+			v[i] = 0.0f;
+			if (!cull && box.Contains(p[i]))
+			{
+				index[l] = i;
+				q[l++] = Vector2(p[i]);
+			}
+		}
+		Elevation(q, z, l);
+		for (int j = 0; j < l; j++)
+			v[index[j]] = Potential(p[index[j]], z[j]);
+	}
+}
 
-	float z = Height(Vector2(p));
+/*!
+\brief Compute the intensity along a vertical column.
+The elevation is computed once for all the points of the column lying inside the box.
+\param p Horizontal coordinates of the column.
+\param y Ordinates of the points.
+\param v Returned intensities.
+\param n Number of points.
+*/
+void TTerrainNode::Intensity(const Vector2& p, const float* y, float* v, int n) const
+{
+	float z = 0.0f;
+	bool elevation = false;
+	for (int i = 0; i < n; i++)
+	{
+		const Vector3 q = p.ToVector3(y[i]);
+		v[i] = 0.0f;
+		if (!box.Contains(q))
+			continue;
+		if (!elevation)
+		{
+			z = Elevation(p);
+			elevation = true;
+		}
+		v[i] = Potential(q, z);
+	}
+}
 
+/*!
+\brief Compute the intensity from the elevation of the terrain above a point inside the box.
+\param p Point.
+\param z Elevation.
+*/
+float TTerrainNode::Potential(const Vector3& p, float z) const
+{
 	// Distance to terrain
 	float dt = z - p[1];
 
@@ -47,3 +363,92 @@ float TTerrainNode::Intensity(const Vector3& p) const
 	float f = 2.0f * TTree::T() * Math::CubicSmoothCompact(localbox.Distance(p), r * r * 0.25f);
 	return Math::Min(e, f);
 }
+
+/*!
+\brief Compute the gradient at a given point.
+The intensity is the minimum of the elevation and the box fields, so the gradient is the one of the smallest field.
+\param p Point.
+*/
+Vector3 TTerrainNode::Gradient(const Vector3& p) const
+{
+	float v;
+	Vector3 g;
+	IntensityGradient(p, v, g);
+	return g;
+}
+
+/*!
+\brief Compute the intensity and the gradient at a given point, evaluating the elevation and its gradient together.
+\param p Point.
+\param v Returned intensity.
+\param g Returned gradient.
+*/
+void TTerrainNode::IntensityGradient(const Vector3& p, float& v, Vector3& g) const
+{
+	if (!box.Contains(p))
+	{
+		v = 0.0f;
+		g = Vector3(0.0f);
+		return;
+	}
+
+	// Distance to the cached terrain, as in Intensity(), and gradient of the exact elevation
+	Vector2 h;
+	float z = Height(Vector2(p), h);
+	if (cache != nullptr)
+		z = Elevation(Vector2(p));
+	float dt = z - p[1];
+
+	// Elevation and box fields
+	float e = Math::CubicSigmoid(dt, r, TTree::T()) + TTree::T();
+	float d = localbox.Distance(p);
+	float f = 2.0f * TTree::T() * Math::CubicSmoothCompact(d, r * r * 0.25f);
+	v = Math::Min(e, f);
+	if (e <= f)
+		g = Vector3(h[0], -1.0f, h[1]) * Math::CubicSigmoidDerivative(dt, r, TTree::T());
+	else
+		g = localbox.DistanceGradient(p) * (2.0f * TTree::T() * Math::CubicSmoothCompactDerivative(d, r * r * 0.25f));
+}
+
+/*!
+\brief Compute the intensity range in a box.
+The elevation field is increasing with the distance to the terrain, and the box field is decreasing
+with the distance to the local box, so both are bounded by their values at the extreme points of the part
+of the box lying inside the primitive box, the intensity being null elsewhere.
+\param b Box.
+*/
+Vector2 TTerrainNode::Range(const Box& b) const
+{
+	if (!box.Intersect(b))
+		return Vector2(0.0f);
+	const Box inside(Vector3::Max(b[0], box[0]), Vector3::Min(b[1], box[1]));
+
+	// Cached elevations are only within the tolerance of the exact ones
+	Vector2 h = HeightRange(Box2D(inside));
+	h = h + Vector2(-Tolerance(), Tolerance());
+
+	// Elevation field
+	float ea = Math::CubicSigmoid(h[0] - inside[1][1], r, TTree::T()) + TTree::T();
+	float eb = Math::CubicSigmoid(h[1] - inside[0][1], r, TTree::T()) + TTree::T();
+
+	// Box field
+	float d = 0.0f;
+	for (int i = 0; i < 8; i++)
+		d = Math::Max(d, localbox.Distance(inside.Corner(i)));
+	float fa = 2.0f * TTree::T() * Math::CubicSmoothCompact(d, r * r * 0.25f);
+	float fb = 2.0f * TTree::T() * Math::CubicSmoothCompact(localbox.Distance(inside), r * r * 0.25f);
+
+	// Points of the box lying outside of the primitive box have a null intensity
+	float a = Math::Min(ea, fa);
+	if (!(b[0] > box[0] && b[1] < box[1]))
+		a = 0.0f;
+	return Vector2(a, Math::Min(eb, fb));
+}
+
+/*!
+\brief Returns the relative cost of the evaluation, derived classes with an expensive elevation should override it.
+*/
+float TTerrainNode::Cost() const
+{
+	return 2.0f;
+}
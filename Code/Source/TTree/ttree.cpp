@@ -1,5 +1,6 @@
 ﻿#include "ttree.h"
 #include "geotree.h"
+#include <algorithm>
 
 /*!
 \class TTree ttree.h
@@ -15,6 +16,11 @@ Example :
 	  )
   );
 Static variable 't' is used to defined where the surface is during visualisation.
+
+Nodes may be allocated from an arena owned by the tree, which then releases them all at once:
+  TArena* arena = new TArena;
+  TArena::Scope scope(arena);
+  TTree* newTree = new TTree(new TBlend(...), arena);
 */
 
 float TTree::t = 7.5f;
@@ -23,18 +29,21 @@ static float epsilon = 1e-4f;
 /*!
 \brief Base tree constructor.
 \param n Root.
+\param a Arena from which the nodes were allocated, owned by the tree, null if they were allocated on the heap.
 */
-TTree::TTree(TNode* n)
+TTree::TTree(TNode* n, TArena* a)
 {
 	root = n;
+	arena = a;
 }
 
 /*!
-\brief Destructor.
+\brief Destructor, deleting the nodes without recursion and then releasing the arena.
 */
 TTree::~TTree()
 {
-	delete root;
+	TNode::Delete(root);
+	delete arena;
 }
 
 /*!
@@ -46,22 +55,167 @@ float TTree::Intensity(const Vector3& p) const
 	return root->Intensity(p) - t;
 }
 
+/*!
+\brief Compute the intensity at a set of points.
+Nearby points should be given together, so that the tree is pruned once for a whole packet.
+\param p Points.
+\param v Returned intensities.
+\param n Number of points.
+*/
+void TTree::Intensity(const Vector3* p, float* v, int n) const
+{
+	root->Intensity(p, v, n);
+	for (int i = 0; i < n; i++)
+		v[i] = v[i] - t;
+}
+
+/*!
+\brief Compute the intensity along a vertical column.
+Nodes whose value does not depend on the ordinate, such as the elevation of terrains, are evaluated once for the whole column.
+\param p Horizontal coordinates of the column.
+\param y Ordinates of the points.
+\param v Returned intensities.
+\param n Number of points.
+*/
+void TTree::Intensity(const Vector2& p, const float* y, float* v, int n) const
+{
+	root->Intensity(p, y, v, n);
+	for (int i = 0; i < n; i++)
+		v[i] = v[i] - t;
+}
+
 /*!
 \brief Compute the gradient at a given point.
 The function prunes the whole tree data structure, starting from the root node.
 */
 Vector3 TTree::Gradient(const Vector3& p) const
 {
-	return root->Gradient(p);
+	float v;
+	Vector3 g;
+	root->IntensityGradient(p, v, g);
+	return g;
+}
+
+/*!
+\brief Compute the intensity and the gradient at a given point, with a single traversal of the tree.
+\param p Point.
+\param v Returned intensity.
+\param g Returned gradient.
+*/
+void TTree::IntensityGradient(const Vector3& p, float& v, Vector3& g) const
+{
+	root->IntensityGradient(p, v, g);
+	v = v - t;
+}
+
+/*!
+\brief Compute a conservative interval of the field function in a box.
+The surface does not cross the box if the interval does not contain 0.
+\param b Box.
+*/
+Vector2 TTree::Range(const Box& b) const
+{
+	return root->Range(b) - t;
 }
 
 /*!
-\brief Update the root node with a blend
+\brief Blend a node with the tree.
+
+Instead of wrapping the root, the node is inserted as in an incremental bounding volume hierarchy:
+the tree is descended towards the sub-tree whose box would grow the least, which is replaced by its
+blend with the node, and the blends along the path are then rotated and refitted. Repeated blends
+hence keep the tree shallow, with a cost proportional to its depth.
+
+A blend culls its sub-trees with its box, so moving a sub-tree that is not bounded by its box, see
+TNode::Bounded(), under another blend would change the intensity: such nodes are blended with the
+root, and the descent stops at blends whose sub-trees are not all bounded.
 \param n node to blend with root
 */
 void TTree::Blend(TNode* n)
 {
-	root = new TBlend(root, n);
+	const Box leaf = n->GetBox();
+
+	// Descend towards the sibling of the node
+	std::vector<TBlend*> path;
+	TNode* sibling = root;
+	TBlend* blend;
+	while (n->Bounded() && (blend = dynamic_cast<TBlend*>(sibling)) != nullptr && blend->Bounded())
+	{
+		// Cost of a new blend at this level, and growth of the boxes if the node goes further down
+		const float combined = Box(blend->box, leaf).Volume();
+		const float cost = 2.0f * combined;
+		const float inheritance = 2.0f * (combined - blend->box.Volume());
+
+		float down[2];
+		for (int i = 0; i < 2; i++)
+		{
+			const Box box = blend->e[i]->GetBox();
+			down[i] = Box(box, leaf).Volume() + inheritance;
+			if (dynamic_cast<TBlend*>(blend->e[i]) != nullptr)
+				down[i] -= box.Volume();
+		}
+		if (cost < down[0] && cost < down[1])
+			break;
+
+		path.push_back(blend);
+		sibling = blend->e[down[1] < down[0] ? 1 : 0];
+	}
+
+	// Replace the sibling by its blend with the node, allocated from the arena of the tree
+	TArena::Scope scope(arena);
+	TBlend* parent = new TBlend(sibling, n);
+	if (path.empty())
+		root = parent;
+	else
+		path.back()->e[path.back()->e[0] == sibling ? 0 : 1] = parent;
+
+	// Rotate and refit the ancestors, bottom up
+	for (int i = int(path.size()) - 1; i >= 0; i--)
+	{
+		Rotate(path[i]);
+		path[i]->box = Box(path[i]->e[0]->GetBox(), path[i]->e[1]->GetBox());
+	}
+}
+
+/*!
+\brief Swap a sub-tree of a blend with a grand-child of its other sub-tree, if it reduces the volume of the latter.
+Blending being commutative and associative, the intensity is unchanged up to rounding, provided that
+the sub-trees are bounded by their box: other blends are left unchanged.
+\param blend Blend, whose children should be up to date.
+*/
+void TTree::Rotate(TBlend* blend)
+{
+	if (!blend->Bounded())
+		return;
+
+	int best = -1, grandchild = 0;
+	float gain = 0.0f;
+	for (int i = 0; i < 2; i++)
+	{
+		TBlend* child = dynamic_cast<TBlend*>(blend->e[i]);
+		if (child == nullptr)
+			continue;
+
+		// Swapping the other sub-tree with one of the children of this child
+		const Box other = blend->e[1 - i]->GetBox();
+		const float volume = child->box.Volume();
+		for (int j = 0; j < 2; j++)
+		{
+			const float g = volume - Box(other, child->e[1 - j]->GetBox()).Volume();
+			if (g > gain)
+			{
+				gain = g;
+				best = i;
+				grandchild = j;
+			}
+		}
+	}
+	if (best < 0)
+		return;
+
+	TBlend* child = static_cast<TBlend*>(blend->e[best]);
+	std::swap(blend->e[1 - best], child->e[grandchild]);
+	child->box = Box(child->e[0]->GetBox(), child->e[1]->GetBox());
 }
 
 /*!
@@ -73,6 +227,23 @@ Box TTree::GetBox() const
 	return root->GetBox();
 }
 
+/*!
+\brief Return the arena owning the nodes, null if they are allocated on the heap.
+*/
+TArena* TTree::GetArena() const
+{
+	return arena;
+}
+
+/*!
+\brief Check whether the surface may cross a box, so that sampling can skip regions away from the surface.
+\param b Box.
+*/
+bool TTree::Intersect(const Box& b) const
+{
+	return root->Intersect(b);
+}
+
 /*!
 \brief Return the threshold value.
 */
@@ -145,12 +316,16 @@ Vector3 TTree::Dichotomy(Vector3 a, Vector3 b, float va, float vb, float length,
 
 /*!
 \brief Sample the implicit construction tree inside a given box. Used
-by most of the algorithm presented here.
+by most of the algorithm presented here. Boxes that the surface cannot cross are rejected without sampling them.
 \param p point (by reference)
 \param box constrained domain
 */
 bool TTree::GetSample(Vector3& p, const Box& box) const
 {
+	// Boxes away from the surface contain no sample
+	if (!Intersect(box))
+		return false;
+
 	Vector3 a, b;
 	if (!Find(a, true, box, 10000))
 		return false;
@@ -26,3 +26,72 @@ float TVertex::Intensity(const Vector3& p) const
 		return 0.0;
 	return Falloff(SquaredMagnitude(p - c));
 }
+
+/*!
+\brief Compute the intensity at a set of points, skipping packets lying outside of the box.
+\param p Points.
+\param v Returned intensities.
+\param n Number of points.
+*/
+void TVertex::Intensity(const Vector3* p, float* v, int n) const
+{
+	const float rr = r * r;
+	for (int k = 0; k < n; k += PacketSize)
+	{
+		const int m = Math::Min(n - k, PacketSize);
+		const bool cull = !box.Intersect(Box(p + k, m));
+		for (int i = k; i < k + m; i++)
+			v[i] = (cull || !box.Contains(p[i])) ? 0.0f : e * Math::CubicSmoothCompact(SquaredMagnitude(p[i] - c), rr);
+	}
+}
+
+/*!
+\brief Compute the gradient at a given point, defined as the derivative of the cubic falloff.
+\param p Point.
+*/
+Vector3 TVertex::Gradient(const Vector3& p) const
+{
+	float v;
+	Vector3 g;
+	IntensityGradient(p, v, g);
+	return g;
+}
+
+/*!
+\brief Compute the intensity and the gradient at a given point.
+\param p Point.
+\param v Returned intensity.
+\param g Returned gradient.
+*/
+void TVertex::IntensityGradient(const Vector3& p, float& v, Vector3& g) const
+{
+	if (!box.Contains(p))
+	{
+		v = 0.0f;
+		g = Vector3(0.0f);
+		return;
+	}
+	const Vector3 d = p - c;
+	const float dd = SquaredMagnitude(d);
+	v = Falloff(dd);
+	g = d * (2.0f * e * Math::CubicSmoothCompactDerivative(dd, r * r));
+}
+
+/*!
+\brief Compute the intensity range in a box.
+The falloff is monotonic, so it is bounded by the nearest and farthest points of the box.
+\param b Box.
+*/
+Vector2 TVertex::Range(const Box& b) const
+{
+	if (!box.Intersect(b))
+		return Vector2(0.0f);
+	float d = 0.0f;
+	for (int i = 0; i < 8; i++)
+		d = Math::Max(d, SquaredMagnitude(b.Corner(i) - c));
+	float vn = Falloff(b.Distance(c));
+	float vf = Falloff(d);
+
+	// Points of the box lying outside of the primitive box have a null intensity
+	return Vector2(Math::Min(0.0f, Math::Min(vn, vf)), Math::Max(0.0f, Math::Max(vn, vf)));
+}
@@ -0,0 +1,292 @@
+#include "ttree.h"
+
+#include <limits>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define WIDEBLEND_SSE
+#include <xmmintrin.h>
+#endif
+
+/*!
+\class TWideBlend ttree.h
+\brief Blending node with up to Width sub-trees.
+
+The boxes of the sub-trees are stored coordinate by coordinate, so that a point is tested against
+all of them with a few vector comparisons, and only the sub-trees containing the point are evaluated.
+Wide blends are obtained by collapsing a binary hierarchy, see TTreeBVH::Collapse(). Sub-trees are
+summed in order.
+*/
+
+/*!
+\brief Constructor.
+\param children Sub-trees.
+\param n Number of sub-trees, at least one and at most Width.
+*/
+TWideBlend::TWideBlend(TNode** children, int n) : n(n)
+{
+	for (int i = 0; i < Width; i++)
+	{
+		e[i] = i < n ? children[i] : nullptr;
+		const Box c = i < n ? children[i]->GetBox() : Box(Vector3(std::numeric_limits<float>::max()), Vector3(-std::numeric_limits<float>::max()));
+		for (int k = 0; k < 3; k++)
+		{
+			a[k][i] = c[0][k];
+			b[k][i] = c[1][k];
+		}
+		if (i < n)
+			box = i == 0 ? c : Box(box, c);
+	}
+}
+
+/*!
+\brief Delete the sub-trees, see TNode::Delete().
+*/
+TWideBlend::~TWideBlend()
+{
+	for (int i = 0; i < n; i++)
+		Delete(e[i]);
+}
+
+/*!
+\brief Move the sub-trees to a stack.
+\param stack Stack.
+*/
+void TWideBlend::Detach(std::vector<TNode*>& stack)
+{
+	for (int i = 0; i < n; i++)
+	{
+		stack.push_back(e[i]);
+		e[i] = nullptr;
+	}
+	n = 0;
+}
+
+/*!
+\brief Compute the sub-trees whose box contains a point.
+\param p Point.
+\return Mask, bit i being set if the box of the i-th sub-tree contains the point.
+*/
+inline int TWideBlend::Overlap(const Vector3& p) const
+{
+#ifdef WIDEBLEND_SSE
+	const __m128 x = _mm_set1_ps(p[0]);
+	const __m128 y = _mm_set1_ps(p[1]);
+	const __m128 z = _mm_set1_ps(p[2]);
+	int mask = 0;
+	for (int i = 0; i < Width; i += 4)
+	{
+		__m128 in = _mm_and_ps(_mm_cmpgt_ps(x, _mm_load_ps(a[0] + i)), _mm_cmplt_ps(x, _mm_load_ps(b[0] + i)));
+		in = _mm_and_ps(in, _mm_and_ps(_mm_cmpgt_ps(y, _mm_load_ps(a[1] + i)), _mm_cmplt_ps(y, _mm_load_ps(b[1] + i))));
+		in = _mm_and_ps(in, _mm_and_ps(_mm_cmpgt_ps(z, _mm_load_ps(a[2] + i)), _mm_cmplt_ps(z, _mm_load_ps(b[2] + i))));
+		mask |= _mm_movemask_ps(in) << i;
+	}
+	return mask;
+#else
+	int mask = 0;
+	for (int i = 0; i < Width; i++)
+	{
+		const bool in = p[0] > a[0][i] && p[0] < b[0][i] && p[1] > a[1][i] && p[1] < b[1][i] && p[2] > a[2][i] && p[2] < b[2][i];
+		mask |= int(in) << i;
+	}
+	return mask;
+#endif
+}
+
+/*!
+\brief Compute the sub-trees whose box contains a vertical line.
+\param p Horizontal coordinates of the line.
+\return Mask, bit i being set if the box of the i-th sub-tree contains the line.
+*/
+inline int TWideBlend::Overlap(const Vector2& p) const
+{
+#ifdef WIDEBLEND_SSE
+	const __m128 x = _mm_set1_ps(p[0]);
+	const __m128 z = _mm_set1_ps(p[1]);
+	int mask = 0;
+	for (int i = 0; i < Width; i += 4)
+	{
+		__m128 in = _mm_and_ps(_mm_cmpgt_ps(x, _mm_load_ps(a[0] + i)), _mm_cmplt_ps(x, _mm_load_ps(b[0] + i)));
+		in = _mm_and_ps(in, _mm_and_ps(_mm_cmpgt_ps(z, _mm_load_ps(a[2] + i)), _mm_cmplt_ps(z, _mm_load_ps(b[2] + i))));
+		mask |= _mm_movemask_ps(in) << i;
+	}
+	return mask;
+#else
+	int mask = 0;
+	for (int i = 0; i < Width; i++)
+	{
+		const bool in = p[0] > a[0][i] && p[0] < b[0][i] && p[1] > a[2][i] && p[1] < b[2][i];
+		mask |= int(in) << i;
+	}
+	return mask;
+#endif
+}
+
+/*!
+\brief Compute the intensity, summing the sub-trees whose box contains the point.
+\param p Point.
+*/
+float TWideBlend::Intensity(const Vector3& p) const
+{
+	float v = 0.0f;
+	for (int mask = Overlap(p), i = 0; mask != 0; mask >>= 1, i++)
+		if (mask & 1)
+			v += e[i]->Intensity(p);
+	return v;
+}
+
+/*!
+\brief Compute the intensity at a set of points.
+
+Points of every packet are dispatched to the sub-trees whose box contains them, and every sub-tree is evaluated once per packet.
+\param p Points.
+\param v Returned intensities.
+\param n Number of points.
+*/
+void TWideBlend::Intensity(const Vector3* p, float* v, int n) const
+{
+	Vector3 q[PacketSize];
+	float r[PacketSize];
+	int masks[PacketSize];
+	int index[PacketSize];
+	for (int k = 0; k < n; k += PacketSize)
+	{
+		const int m = Math::Min(n - k, PacketSize);
+		const Vector3* pk = p + k;
+		float* vk = v + k;
+		int any = 0;
+		for (int i = 0; i < m; i++)
+		{
+			vk[i] = 0.0f;
+			masks[i] = Overlap(pk[i]);
+			any |= masks[i];
+		}
+		for (int j = 0; j < this->n; j++)
+		{
+			if (!(any & (1 << j)))
+				continue;
+			int l = 0;
+			for (int i = 0; i < m; i++)
+			{
+				if (masks[i] & (1 << j))
+				{
+					index[l] = i;
+					q[l++] = pk[i];
+				}
+			}
+			e[j]->Intensity(q, r, l);
+			for (int i = 0; i < l; i++)
+				vk[index[i]] += r[i];
+		}
+	}
+}
+
+/*!
+\brief Compute the intensity along a vertical column.
+The sub-trees missing the column are skipped, the others are given the points lying inside their box, by packets.
+\param p Horizontal coordinates of the column.
+\param y Ordinates of the points.
+\param v Returned intensities.
+\param n Number of points.
+*/
+void TWideBlend::Intensity(const Vector2& p, const float* y, float* v, int n) const
+{
+	float q[PacketSize];
+	float r[PacketSize];
+	int index[PacketSize];
+	for (int i = 0; i < n; i++)
+		v[i] = 0.0f;
+	for (int mask = Overlap(p), j = 0; mask != 0; mask >>= 1, j++)
+	{
+		if (!(mask & 1))
+			continue;
+		for (int k = 0; k < n; k += PacketSize)
+		{
+			const int m = Math::Min(n - k, PacketSize);
+			int l = 0;
+			for (int i = k; i < k + m; i++)
+			{
+				if (y[i] > a[1][j] && y[i] < b[1][j])
+				{
+					index[l] = i;
+					q[l++] = y[i];
+				}
+			}
+			if (l == 0)
+				continue;
+			e[j]->Intensity(p, q, r, l);
+			for (int i = 0; i < l; i++)
+				v[index[i]] += r[i];
+		}
+	}
+}
+
+/*!
+\brief Compute the gradient, summing the sub-trees whose box contains the point.
+\param p Point.
+*/
+Vector3 TWideBlend::Gradient(const Vector3& p) const
+{
+	Vector3 g(0.0f);
+	for (int mask = Overlap(p), i = 0; mask != 0; mask >>= 1, i++)
+		if (mask & 1)
+			g += e[i]->Gradient(p);
+	return g;
+}
+
+/*!
+\brief Compute the intensity and the gradient at a given point, with a single traversal of the sub-trees.
+\param p Point.
+\param v Returned intensity.
+\param g Returned gradient.
+*/
+void TWideBlend::IntensityGradient(const Vector3& p, float& v, Vector3& g) const
+{
+	v = 0.0f;
+	g = Vector3(0.0f);
+	for (int mask = Overlap(p), i = 0; mask != 0; mask >>= 1, i++)
+	{
+		if (!(mask & 1))
+			continue;
+		float vi;
+		Vector3 gi;
+		e[i]->IntensityGradient(p, vi, gi);
+		v += vi;
+		g += gi;
+	}
+}
+
+/*!
+\brief Compute the intensity range of the blend in a box, defined as the sum of the ranges of the sub-trees.
+\param b Box.
+*/
+Vector2 TWideBlend::Range(const Box& b) const
+{
+	if (!box.Intersect(b))
+		return Vector2(0.0f);
+	Vector2 r(0.0f);
+	for (int i = 0; i < n; i++)
+		r = r + e[i]->Range(b);
+	return r;
+}
+
+/*!
+\brief Check whether all sub-trees are bounded by their box, which TTreeBVH::Collapse() guarantees.
+*/
+bool TWideBlend::Bounded() const
+{
+	for (int i = 0; i < n; i++)
+		if (!e[i]->Bounded())
+			return false;
+	return true;
+}
+
+/*!
+\brief Returns the cost of the evaluation of all sub-trees.
+*/
+float TWideBlend::Cost() const
+{
+	float c = 0.0f;
+	for (int i = 0; i < n; i++)
+		c += e[i]->Cost();
+	return c;
+}
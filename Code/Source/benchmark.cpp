@@ -0,0 +1,560 @@
+#include "ttree.h"
+#include "bvh.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <random>
+
+/*
+	Micro benchmarks of the field function evaluation, run with the "benchmark" argument.
+	Points are drawn with a local generator, so that the random sequence of the scenes is left untouched.
+	Benchmarks that check their results return the number of failed checks.
+*/
+
+/*!
+\brief Time the Intensity queries of a tree at a set of points.
+\param tree Tree.
+\param points Points.
+\return Time per query, in nanoseconds.
+*/
+static double TimeIntensity(const TTree& tree, const std::vector<Vector3>& points)
+{
+	volatile float sum = 0.0f;
+	auto start = std::chrono::high_resolution_clock::now();
+	for (const Vector3& p : points)
+		sum = sum + tree.Intensity(p);
+	auto end = std::chrono::high_resolution_clock::now();
+	return std::chrono::duration<double, std::nano>(end - start).count() / points.size();
+}
+
+/*!
+\brief Compare the evaluation of a tree by single and batched queries.
+Points are sampled along rows of the box, as a polygonizer would do.
+\param name Name of the scene.
+\param tree Tree.
+\param n Number of points.
+\return Number of mismatches.
+*/
+int Benchmark(const char* name, const TTree* tree, int n)
+{
+	const Box box = tree->GetBox();
+	std::mt19937 generator(0);
+	std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+	const int row = TNode::PacketSize;
+	n = n / row * row;
+	std::vector<Vector3> points(n);
+	for (int i = 0; i < n; i += row)
+	{
+		const Vector3 u(uniform(generator), uniform(generator), uniform(generator));
+		const Vector3 step = Vector3((box[1] - box[0])[0] / 350.0f, 0.0f, 0.0f);
+		for (int j = 0; j < row; j++)
+			points[i + j] = box[0] + (box[1] - box[0]) * u + step * float(j);
+	}
+
+	const double tt = 1.0e-6 * n * TimeIntensity(*tree, points);
+
+	std::vector<float> values(n);
+	auto start = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < n; i += row)
+		tree->Intensity(points.data() + i, values.data() + i, row);
+	auto end = std::chrono::high_resolution_clock::now();
+	const double tb = std::chrono::duration<double, std::milli>(end - start).count();
+
+	// Multiplications and additions of the scalar noise may be fused by the compiler, not those of the packet kernels
+	int mismatches = 0;
+	float error = 0.0f;
+	for (int i = 0; i < n; i++)
+	{
+		const float v = tree->Intensity(points[i]);
+		const float d = Math::Abs(v - values[i]) / Math::Max(1.0f, Math::Abs(v));
+		error = Math::Max(error, d);
+		if (d > 1.0e-4f)
+			mismatches++;
+	}
+
+	std::cout << name << ": " << n << " points, tree " << tt << " ms, batched " << tb << " ms x" << tt / tb << ", maximum relative difference " << error
+		<< ", " << mismatches << " mismatches" << std::endl;
+	return mismatches;
+}
+
+/*!
+\brief Create a set of primitives mixing clusters of cheap vertices with a few expensive cliffs.
+The same generator seed always yields the same set, so that several hierarchies can be built from identical primitives.
+\param n Number of vertices.
+*/
+static std::vector<TNode*> BenchmarkPrimitives(int n)
+{
+	std::mt19937 generator(1);
+	std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+	std::vector<TNode*> nodes;
+	for (int i = 0; i < 4; i++)
+	{
+		const Vector2 c(uniform(generator) * 2000.0f, uniform(generator) * 2000.0f);
+		const float s = 200.0f + uniform(generator) * 300.0f;
+		nodes.push_back(new TAnalyticCliff(Box2D(c, s).ToBox(0.0f, 100.0f), Vector2(0.0f, 100.0f)));
+	}
+	Vector3 cluster;
+	for (int i = 0; i < n; i++)
+	{
+		if (i % 256 == 0)
+			cluster = Vector3(uniform(generator) * 2000.0f, uniform(generator) * 100.0f, uniform(generator) * 2000.0f);
+		const Vector3 p = cluster + Vector3(uniform(generator) - 0.5f, uniform(generator) - 0.5f, uniform(generator) - 0.5f) * 300.0f;
+		nodes.push_back(new TVertex(p, 10.0f + uniform(generator) * 20.0f, 1.0f));
+	}
+	return nodes;
+}
+
+/*!
+\brief Compare the hierarchies built by splitting nodes in the middle and with the binned volume cost heuristic,
+and the latter collapsed into wide blends, by the time per Intensity query,
+and time the construction of a large hierarchy.
+\param n Number of points.
+*/
+void BenchmarkBVH(int n)
+{
+	const TTreeBVH::Split splits[3] = { TTreeBVH::Split::Middle, TTreeBVH::Split::VolumeCost, TTreeBVH::Split::VolumeCost };
+	const bool wide[3] = { false, false, true };
+	const char* names[3] = { "middle", "volume cost", "volume cost wide" };
+	for (int k = 0; k < 3; k++)
+	{
+		std::vector<TNode*> nodes = BenchmarkPrimitives(4096);
+		auto start = std::chrono::high_resolution_clock::now();
+		TNode* hierarchy = TTreeBVH::OptimizeHierarchy(nodes, 0, int(nodes.size()), splits[k]);
+		TTree tree(wide[k] ? TTreeBVH::Collapse(hierarchy) : hierarchy);
+		auto end = std::chrono::high_resolution_clock::now();
+		const double tc = std::chrono::duration<double, std::milli>(end - start).count();
+
+		const Box box = tree.GetBox();
+		std::mt19937 generator(0);
+		std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+		std::vector<Vector3> points(n);
+		for (int i = 0; i < n; i++)
+			points[i] = box[0] + (box[1] - box[0]) * Vector3(uniform(generator), uniform(generator), uniform(generator));
+
+		const double tt = TimeIntensity(tree, points);
+
+		// Construction time of a large hierarchy
+		std::vector<TNode*> large = BenchmarkPrimitives(1 << 20);
+		start = std::chrono::high_resolution_clock::now();
+		TNode* root = TTreeBVH::OptimizeHierarchy(large, 0, int(large.size()), splits[k]);
+		if (wide[k])
+			root = TTreeBVH::Collapse(root);
+		end = std::chrono::high_resolution_clock::now();
+		const double tl = std::chrono::duration<double, std::milli>(end - start).count();
+		delete root;
+
+		std::cout << "bvh " << names[k] << ": " << nodes.size() << " primitives built in " << tc << " ms, " << tt << " ns per query, " << large.size() << " primitives built in " << tl << " ms" << std::endl;
+	}
+}
+
+/*!
+\brief Compare a hierarchy of vertices with a vertex cloud storing the same vertices,
+by the memory of the nodes and the time per Intensity query.
+\param n Number of points.
+*/
+void BenchmarkVertexCloud(int n)
+{
+	std::mt19937 generator(2);
+	std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+	const int size = 100000;
+	std::vector<Vector3> centers(size);
+	std::vector<float> radii(size), energies(size);
+	std::vector<TNode*> nodes(size);
+	for (int i = 0; i < size; i++)
+	{
+		centers[i] = Vector3(uniform(generator), 0.1f * uniform(generator), uniform(generator)) * 2000.0f;
+		radii[i] = 5.0f + 10.0f * uniform(generator);
+		energies[i] = uniform(generator) - 0.3f;
+		nodes[i] = new TVertex(centers[i], radii[i], energies[i]);
+	}
+	const TTree hierarchy(TTreeBVH::OptimizeHierarchy(nodes, 0, size, TTreeBVH::Split::VolumeCost));
+	TVertexCloud* cloud = new TVertexCloud(centers, radii, energies);
+	const TTree tree(cloud);
+
+	// Half of the points are drawn close to vertices
+	std::vector<Vector3> points(n);
+	for (int i = 0; i < n; i++)
+		points[i] = i % 2 ? Vector3(uniform(generator), 0.1f * uniform(generator), uniform(generator)) * 2000.0f
+			: centers[i % size] + (Vector3(uniform(generator), uniform(generator), uniform(generator)) - Vector3(0.5f)) * 20.0f;
+
+	const double th = TimeIntensity(hierarchy, points);
+	const double tc = TimeIntensity(tree, points);
+
+	float error = 0.0f;
+	for (int i = 0; i < n; i++)
+		error = Math::Max(error, Math::Abs(hierarchy.Intensity(points[i]) - tree.Intensity(points[i])));
+
+	const size_t mh = size * (sizeof(TVertex) + sizeof(TBlend));
+	std::cout << "vertices " << size << ": hierarchy " << mh / 1024 << " KB " << th << " ns per query, cloud " << cloud->Memory() / 1024
+		<< " KB " << tc << " ns per query x" << th / tc << ", maximum difference " << error << std::endl;
+}
+
+/*!
+\brief Compare nodes allocated on the heap and from an arena, by the time to build a collapsed hierarchy,
+to query it and to delete it, and time the deletion of a degenerate tree as deep as it has primitives.
+\param n Number of points.
+*/
+void BenchmarkArena(int n)
+{
+	const char* names[2] = { "heap", "arena" };
+	for (int k = 0; k < 2; k++)
+	{
+		TArena* arena = k == 1 ? new TArena : nullptr;
+		TArena::Scope scope(arena);
+
+		auto start = std::chrono::high_resolution_clock::now();
+		std::vector<TNode*> nodes = BenchmarkPrimitives(1 << 18);
+		TTree* tree = new TTree(TTreeBVH::Collapse(TTreeBVH::OptimizeHierarchy(nodes, 0, int(nodes.size()), TTreeBVH::Split::VolumeCost)), arena);
+		auto end = std::chrono::high_resolution_clock::now();
+		const double tc = std::chrono::duration<double, std::milli>(end - start).count();
+
+		const Box box = tree->GetBox();
+		std::mt19937 generator(0);
+		std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+		volatile float sum = 0.0f;
+		start = std::chrono::high_resolution_clock::now();
+		for (int i = 0; i < n; i++)
+			sum = sum + tree->Intensity(box[0] + (box[1] - box[0]) * Vector3(uniform(generator), uniform(generator), uniform(generator)));
+		end = std::chrono::high_resolution_clock::now();
+		const double tq = std::chrono::duration<double, std::nano>(end - start).count() / n;
+
+		const size_t memory = arena != nullptr ? arena->Memory() : 0;
+		start = std::chrono::high_resolution_clock::now();
+		delete tree;
+		end = std::chrono::high_resolution_clock::now();
+		const double td = std::chrono::duration<double, std::milli>(end - start).count();
+
+		// Degenerate tree, each blend nesting the previous one
+		arena = k == 1 ? new TArena : nullptr;
+		TArena::Scope chain(arena);
+		TNode* node = new TVertex(Vector3(0.0f), 1.0f, 1.0f);
+		for (int i = 1; i < int(nodes.size()); i++)
+			node = new TBlend(node, new TVertex(Vector3(float(i), 0.0f, 0.0f), 1.0f, 1.0f));
+		tree = new TTree(node, arena);
+		start = std::chrono::high_resolution_clock::now();
+		delete tree;
+		end = std::chrono::high_resolution_clock::now();
+		const double tl = std::chrono::duration<double, std::milli>(end - start).count();
+
+		std::cout << "nodes " << names[k] << ": " << nodes.size() << " primitives built in " << tc << " ms, " << tq << " ns per query, deleted in " << td
+			<< " ms, " << memory / 1024 << " KB of blocks, degenerate tree deleted in " << tl << " ms" << std::endl;
+	}
+}
+
+/*!
+\brief Compare a cliff evaluating its elevation analytically with the same cliff caching its elevations,
+by the time per Intensity query, before and after the tiles are baked, and the error of the cached elevation,
+which should remain within the tolerance of the node.
+\param n Number of points.
+\return Number of elevations outside of the tolerance.
+*/
+int BenchmarkTerrainCache(int n)
+{
+	const Box2D domain(Vector2(-200.0f), Vector2(200.0f));
+	const TTree exact(new TAnalyticCliff(domain.ToBox(-20.0f, 70.0f), Vector2(-20.0f, 70.0f)));
+	TAnalyticCliff* cliff = new TAnalyticCliff(domain.ToBox(-20.0f, 70.0f), Vector2(-20.0f, 70.0f));
+	cliff->SetCache(1.0f, 0.05f, size_t(64) << 20);
+	const TTree cached(cliff);
+
+	const Box box = exact.GetBox();
+	std::mt19937 generator(3);
+	std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+	std::vector<Vector3> points(n);
+	for (int i = 0; i < n; i++)
+		points[i] = box[0] + (box[1] - box[0]) * Vector3(uniform(generator), uniform(generator), uniform(generator));
+
+	const double te = TimeIntensity(exact, points);
+	const double tb = TimeIntensity(cached, points);
+	const double tc = TimeIntensity(cached, points);
+
+	float error = 0.0f;
+	int outside = 0;
+	for (int i = 0; i < n; i++)
+	{
+		const float e = Math::Abs(cliff->Elevation(Vector2(points[i])) - cliff->Height(Vector2(points[i])));
+		error = Math::Max(error, e);
+		if (e > cliff->Tolerance())
+			outside++;
+	}
+
+	std::cout << "terrain cache: analytic " << te << " ns per query, cached " << tb << " ns per query while baking, " << tc
+		<< " ns per query x" << te / tc << ", maximum elevation error " << error << " for a tolerance of "
+		<< cliff->Tolerance() << ", " << outside << " elevations outside of the tolerance" << std::endl;
+	return outside;
+}
+
+/*!
+\brief Check a heightfield node sampled from a cliff on a grid whose sizes are not multiples of the tiles,
+by the error of its elevation against the cliff, at the samples and between them, and by the number of intensities
+lying outside of the ranges computed over random boxes, with both interpolations. Also round trip the samples
+through 32-bit and 16-bit raw files, and time the loading of the latter.
+\param n Number of points.
+\return Number of intensities outside of the ranges, and of failed or inexact round trips.
+*/
+int BenchmarkHeightField(int n)
+{
+	const Box2D domain(Vector2(-200.0f, -150.0f), Vector2(200.0f, 150.0f));
+	const TAnalyticCliff cliff(domain.ToBox(-20.0f, 70.0f), Vector2(-20.0f, 70.0f));
+	const int nx = 301, ny = 203;
+	const Vector2 size = domain[1] - domain[0];
+	auto sample = [&](int i, int j) { return domain[0] + Vector2(size[0] * j / float(nx - 1), size[1] * i / float(ny - 1)); };
+	HeightField field(nx, ny, domain);
+	for (int i = 0; i < ny; i++)
+		for (int j = 0; j < nx; j++)
+			field.Set(i, j, cliff.Height(sample(i, j)));
+
+	std::mt19937 generator(4);
+	std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+	int failures = 0;
+	for (int k = 0; k < 2; k++)
+	{
+		const THeightField node(field, 10.0f, k == 1);
+
+		// Elevation
+		float samples = 0.0f, error = 0.0f;
+		for (int i = 0; i < ny; i++)
+			for (int j = 0; j < nx; j++)
+				samples = Math::Max(samples, Math::Abs(node.Height(sample(i, j)) - field.Get(i, j)));
+		for (int i = 0; i < n; i++)
+		{
+			const Vector2 p = domain[0] + Vector2(size[0] * uniform(generator), size[1] * uniform(generator));
+			error = Math::Max(error, Math::Abs(node.Height(p) - cliff.Height(p)));
+		}
+
+		// Ranges, sampled at the corners of the boxes and inside them
+		const Box box = node.GetBox();
+		int outside = 0;
+		for (int i = 0; i < n / 64; i++)
+		{
+			const Vector3 a = box[0] + (box[1] - box[0]) * Vector3(uniform(generator), uniform(generator), uniform(generator));
+			const Vector3 s = Vector3(uniform(generator) * 40.0f, uniform(generator) * 20.0f, uniform(generator) * 40.0f);
+			const Box b(a, a + s);
+			const Vector2 range = node.Range(b);
+			for (int j = 0; j < 64; j++)
+			{
+				const Vector3 p = j < 8 ? b.Corner(j) : a + s * Vector3(uniform(generator), uniform(generator), uniform(generator));
+				const float v = node.Intensity(p);
+				if (v < range[0] - 1e-4f || v > range[1] + 1e-4f)
+					outside++;
+			}
+		}
+
+		std::cout << "heightfield " << (k == 1 ? "bicubic" : "bilinear") << ": " << nx << "x" << ny << " samples, maximum error " << samples
+			<< " at the samples, " << error << " against the cliff, " << outside << " intensities outside of the ranges" << std::endl;
+		failures += outside;
+	}
+
+	// Raw files
+	std::vector<float> values(size_t(nx) * ny);
+	std::vector<uint16_t> quantized(values.size());
+	const float a = field.Min(), b = field.Max();
+	for (int i = 0; i < ny; i++)
+	{
+		for (int j = 0; j < nx; j++)
+		{
+			values[size_t(i) * nx + j] = field.Get(i, j);
+			quantized[size_t(i) * nx + j] = uint16_t(Math::Clamp((field.Get(i, j) - a) / (b - a)) * 65535.0f + 0.5f);
+		}
+	}
+	std::ofstream("benchmark.raw", std::ios::binary).write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(float));
+	std::ofstream("benchmark16.raw", std::ios::binary).write(reinterpret_cast<const char*>(quantized.data()), quantized.size() * sizeof(uint16_t));
+	HeightField raw, raw16;
+	const bool loaded = raw.LoadRaw("benchmark.raw", nx, ny, domain) && raw16.LoadRaw16("benchmark16.raw", nx, ny, domain, a, b);
+	float e32 = 0.0f, e16 = 0.0f;
+	for (int i = 0; loaded && i < ny; i++)
+	{
+		for (int j = 0; j < nx; j++)
+		{
+			e32 = Math::Max(e32, Math::Abs(raw.Get(i, j) - field.Get(i, j)));
+			e16 = Math::Max(e16, Math::Abs(raw16.Get(i, j) - field.Get(i, j)));
+		}
+	}
+
+	// Loading time of a large 16-bit grid
+	const int dem = 4096;
+	std::vector<uint16_t> large(size_t(dem) * dem);
+	for (size_t i = 0; i < large.size(); i++)
+		large[i] = uint16_t(i * 2654435761u >> 16);
+	std::ofstream("benchmark16.raw", std::ios::binary).write(reinterpret_cast<const char*>(large.data()), large.size() * sizeof(uint16_t));
+	auto start = std::chrono::high_resolution_clock::now();
+	const bool read = raw16.LoadRaw16("benchmark16.raw", dem, dem, domain, 0.0f, 1000.0f);
+	auto end = std::chrono::high_resolution_clock::now();
+	std::remove("benchmark.raw");
+	std::remove("benchmark16.raw");
+
+	std::cout << "raw heightfields: " << (loaded ? "loaded" : "failed") << ", maximum error " << e32 << " in 32 bits, " << e16 << " in 16 bits for a step of "
+		<< (b - a) / 65535.0f << ", " << dem << "x" << dem << " 16-bit grid " << (read ? "loaded" : "failed") << " in "
+		<< std::chrono::duration<double, std::milli>(end - start).count() << " ms" << std::endl;
+
+	// 32-bit samples are stored exactly, 16-bit ones within a quantization step
+	failures += !loaded + !read + (e32 != 0.0f) + (e16 > (b - a) / 65535.0f);
+	return failures;
+}
+
+/*!
+\brief Round trip a field through the tiled format, written from memory and converted from a raw file, on a grid
+whose sizes are not multiples of the tiles, and compare the samples, the interpolated values, the gradients and
+the elevations of heightfield nodes with those of the field.
+\param n Number of points.
+\return Number of different samples and gradients, and of failed round trips.
+*/
+int BenchmarkTiledHeightField(int n)
+{
+	const Box2D domain(Vector2(-100.0f, -300.0f), Vector2(200.0f, 50.0f));
+	const int nx = 333, ny = 150;
+	std::mt19937 generator(5);
+	std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+	HeightField field(nx, ny, domain);
+	for (int i = 0; i < ny; i++)
+		for (int j = 0; j < nx; j++)
+			field.Set(i, j, 10.0f * sin(0.05f * j) * cos(0.08f * i) + uniform(generator));
+
+	std::vector<float> values(size_t(nx) * ny);
+	for (int i = 0; i < ny; i++)
+		for (int j = 0; j < nx; j++)
+			values[size_t(i) * nx + j] = field.Get(i, j);
+	std::ofstream("benchmark.raw", std::ios::binary).write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(float));
+
+	const char* names[2] = { "field", "raw" };
+	int failures = 0;
+	for (int k = 0; k < 2; k++)
+	{
+		TiledHeightField tiled;
+		const bool created = k == 0 ? TiledHeightField::Create("benchmark.ithf", field, 64) : TiledHeightField::Create("benchmark.ithf", "benchmark.raw", nx, ny, domain, 32);
+		if (!created || !tiled.Open("benchmark.ithf") || tiled.SizeX() != nx || tiled.SizeY() != ny)
+		{
+			std::cout << "tiled heightfield from " << names[k] << ": failed" << std::endl;
+			failures++;
+			continue;
+		}
+
+		int samples = 0, gradients = 0;
+		for (int i = 0; i < ny; i++)
+		{
+			for (int j = 0; j < nx; j++)
+			{
+				samples += tiled.Get(i, j) != field.Get(i, j);
+				gradients += !(tiled.Gradient(i, j) == field.Gradient(i, j));
+			}
+		}
+
+		const THeightField a(field, 5.0f, true), b(tiled, 5.0f, true);
+		float bilinear = 0.0f, heights = 0.0f;
+		for (int i = 0; i < n; i++)
+		{
+			const Vector2 p = domain[0] + Vector2((domain[1] - domain[0])[0] * uniform(generator), (domain[1] - domain[0])[1] * uniform(generator));
+			bilinear = Math::Max(bilinear, Math::Abs(tiled.GetValueBilinear(p) - field.GetValueBilinear(p)));
+			heights = Math::Max(heights, Math::Abs(a.Height(p) - b.Height(p)));
+		}
+
+		std::cout << "tiled heightfield from " << names[k] << ": " << nx << "x" << ny << " samples, " << samples << " different samples, "
+			<< gradients << " different gradients, maximum difference " << bilinear << " of the bilinear interpolation, "
+			<< heights << " of the node elevation" << std::endl;
+		failures += samples + gradients;
+	}
+
+	// Truncated files are rejected
+	std::vector<char> file;
+	{
+		std::ifstream in("benchmark.ithf", std::ios::binary);
+		file.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+	}
+	std::ofstream("benchmark.ithf", std::ios::binary).write(file.data(), file.size() / 2);
+	TiledHeightField truncated;
+	const bool opened = truncated.Open("benchmark.ithf");
+	std::cout << "tiled heightfield truncated: " << (opened ? "opened" : "rejected") << std::endl;
+	truncated.Close();
+	std::remove("benchmark.raw");
+	std::remove("benchmark.ithf");
+	return failures + opened;
+}
+
+/*!
+\brief Compare the quadtree of heightfield nodes with a brute-force scan of the cells of the grid, on square, non-square and tiny grids.
+For random boxes inside the local box of a node, the box is crossed by the terrain if the elevations at the corners of one of the cells
+under it span its vertical range: the quadtree should never miss such a box, nor a box in which a sampled elevation lies.
+Also time the sampling of the surface in the boxes, which skips those that the quadtree excludes.
+\param n Number of boxes.
+\return Number of missed boxes.
+*/
+int BenchmarkQuadtree(int n)
+{
+	const int sizes[3][2] = { { 257, 257 }, { 301, 203 }, { 5, 3 } };
+	std::mt19937 generator(6);
+	std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+	int failures = 0;
+	for (int g = 0; g < 3; g++)
+	{
+		const int nx = sizes[g][0], ny = sizes[g][1];
+		const Box2D domain(Vector2(-200.0f, -150.0f), Vector2(200.0f, 150.0f));
+		const TAnalyticCliff cliff(domain.ToBox(-20.0f, 70.0f), Vector2(-20.0f, 70.0f));
+		const Vector2 cell((domain[1] - domain[0])[0] / float(nx - 1), (domain[1] - domain[0])[1] / float(ny - 1));
+		HeightField field(nx, ny, domain);
+		for (int i = 0; i < ny; i++)
+			for (int j = 0; j < nx; j++)
+				field.Set(i, j, cliff.Height(domain[0] + Vector2(j * cell[0], i * cell[1])));
+
+		for (int k = 0; k < 2; k++)
+		{
+			const float r = 10.0f;
+			THeightField* node = new THeightField(field, r, k == 1);
+			const TTree tree(node);
+			const Box local = tree.GetBox().Extended(Vector3(-0.5f * r));
+			int crossed = 0, culled = 0, missed = 0;
+			std::vector<Box> boxes;
+			for (int l = 0; l < n; l++)
+			{
+				const Vector3 s = (local[1] - local[0]) * Vector3(uniform(generator), uniform(generator), uniform(generator)) * 0.1f;
+				const Vector3 a = local[0] + (local[1] - local[0] - s) * Vector3(uniform(generator), uniform(generator), uniform(generator));
+				const Box b = Box(a, a + s).Extended(Vector3(-1e-3f));
+				boxes.push_back(b);
+				const bool intersect = tree.Intersect(b);
+				culled += !intersect;
+
+				// Cells under the box
+				bool brute = false;
+				const int j0 = Math::Min(Math::Max(int(floor((b[0][0] - domain[0][0]) / cell[0])), 0), nx - 2);
+				const int j1 = Math::Min(Math::Max(int(floor((b[1][0] - domain[0][0]) / cell[0])), 0), nx - 2);
+				const int i0 = Math::Min(Math::Max(int(floor((b[0][2] - domain[0][1]) / cell[1])), 0), ny - 2);
+				const int i1 = Math::Min(Math::Max(int(floor((b[1][2] - domain[0][1]) / cell[1])), 0), ny - 2);
+				for (int i = i0; i <= i1 && k == 0; i++)
+				{
+					for (int j = j0; j <= j1; j++)
+					{
+						const float z[4] = { field.Get(i, j), field.Get(i, j + 1), field.Get(i + 1, j), field.Get(i + 1, j + 1) };
+						const float zmin = Math::Min(Math::Min(z[0], z[1]), Math::Min(z[2], z[3]));
+						const float zmax = Math::Max(Math::Max(z[0], z[1]), Math::Max(z[2], z[3]));
+						brute = brute || (zmax >= b[0][1] && zmin <= b[1][1]);
+					}
+				}
+
+				// Sampled elevations
+				for (int m = 0; m < 16 && !brute; m++)
+				{
+					const float h = node->Height(Vector2(b[0][0] + (b[1][0] - b[0][0]) * uniform(generator), b[0][2] + (b[1][2] - b[0][2]) * uniform(generator)));
+					brute = h >= b[0][1] && h <= b[1][1];
+				}
+				crossed += brute;
+				missed += brute && !intersect;
+			}
+
+			int samples = 0;
+			auto start = std::chrono::high_resolution_clock::now();
+			for (int l = 0; l < 100; l++)
+			{
+				Vector3 p;
+				samples += tree.GetSample(p, boxes[l]);
+			}
+			auto end = std::chrono::high_resolution_clock::now();
+
+			std::cout << "quadtree " << (k == 1 ? "bicubic " : "bilinear ") << nx << "x" << ny << ": " << n << " boxes, " << crossed << " crossed, "
+				<< culled << " culled, " << missed << " missed, " << samples << " samples found in 100 boxes in "
+				<< std::chrono::duration<double, std::milli>(end - start).count() << " ms" << std::endl;
+			failures += missed;
+		}
+	}
+	return failures;
+}
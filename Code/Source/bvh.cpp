@@ -1,70 +1,353 @@
 #include "bvh.h"
 #include "ttree.h"
 #include <algorithm>
+#include <limits>
+
+// Primitive of the construction, with its box, center and cost computed once
+struct BVHPrimitive
+{
+	TNode* node;	//!< Node.
+	Box box;		//!< %Box of the node.
+	Vector3 c;		//!< Center of the box.
+	float cost;		//!< Cost of the evaluation of the node.
+
+	BVHPrimitive() : node(nullptr), box(Vector3(0.0f), Vector3(0.0f)), cost(0.0f)
+	{
+	}
+};
+
+static const int BVHTaskSize = 4096;	//!< Ranges of primitives larger than this are split by parallel tasks.
 
 /*!
-\brief Create a bounding box hierarchy.
+\brief Compute the boxes, centers and costs of a range of primitives.
+\param pts Primitives.
+\param begin start index
+\param end end index
 */
-TNode* TTreeBVH::BVHRecursive(std::vector<TNode*>& pts, unsigned int begin, unsigned int end)
+static std::vector<BVHPrimitive> BVHPrimitives(const std::vector<TNode*>& pts, unsigned int begin, unsigned int end)
 {
-	/*
-	\brief BVH space partition predicate. Could also use a lambda function to avoid the structure.
-	*/
-	struct BVHPartitionPredicate
+	std::vector<BVHPrimitive> prims(end - begin);
+#pragma omp parallel for
+	for (int i = 0; i < int(prims.size()); i++)
 	{
-		int axis;
-		float cut;
-
-		BVHPartitionPredicate(int a, float c) : axis(a), cut(c)
-		{
-		}
+		BVHPrimitive& p = prims[i];
+		p.node = pts[begin + i];
+		p.box = p.node->GetBox();
+		p.c = (p.box[0] + p.box[1]) / 2.0f;
+		p.cost = p.node->Cost();
+	}
+	return prims;
+}
 
-		bool operator()(TNode* p) const
-		{
-			Vector3 c = (p->GetBox().Vertex(0) + p->GetBox().Vertex(1)) / 2.0f;
-			return c[axis] < cut;
-		}
-	};
+/*!
+\brief Build a hierarchy over a range of primitives, in parallel, and reorder the range as its leaves.
+Blends are allocated from the arena of the calling thread, see TArena::Scope.
+\param pts Primitives.
+\param begin start index
+\param end end index
+\param build Recursive builder.
+*/
+static TNode* BVHBuild(std::vector<TNode*>& pts, unsigned int begin, unsigned int end, TNode* (*build)(std::vector<BVHPrimitive>&, int, int))
+{
+	std::vector<BVHPrimitive> prims = BVHPrimitives(pts, begin, end);
+	TNode* root = nullptr;
+	TArena* arena = TArena::Current();
+#pragma omp parallel
+	{
+		// Tasks run on any thread of the team, which allocates the blends from the arena of the caller
+		TArena::Scope scope(arena);
+#pragma omp single
+		root = build(prims, 0, int(prims.size()));
+	}
+	for (unsigned int i = begin; i < end; i++)
+		pts[i] = prims[i - begin].node;
+	return root;
+}
 
+/*!
+\brief Create a bounding box hierarchy by cutting nodes in the middle of their box.
+\param prims Primitives, reordered.
+\param begin start index
+\param end end index
+*/
+static TNode* BVHMiddleRecursive(std::vector<BVHPrimitive>& prims, int begin, int end)
+{
 	// If leaf, returns primitive
 	if (end - begin <= 1)
-		return pts[begin];
+		return prims[begin].node;
 
 	// Bounding box of primitive in [begin, end] range
-	Box bbox = pts[begin]->GetBox();
-	for (unsigned int i = begin + 1; i < end; i++)
-		bbox = Box(bbox, pts[i]->GetBox());
+	Box bbox = prims[begin].box;
+	for (int i = begin + 1; i < end; i++)
+		bbox = Box(bbox, prims[i].box);
 
 	// Find the most stretched axis of the bounding box
 	// Cut the box in the middle of this stretched axis
-	Vector3 diag = bbox[2] - bbox[1];
+	Vector3 diag = bbox[1] - bbox[0];
 	int stretchedAxis = diag.MaxIndex();
 	float axisMiddleCut = (bbox[0][stretchedAxis] + bbox[1][stretchedAxis]) / 2.0f;
 
 	// Partition our primitives in relation to the axisMiddleCut
-	auto pmid = std::partition(pts.begin() + begin, pts.begin() + end, BVHPartitionPredicate(stretchedAxis, axisMiddleCut));
+	auto pmid = std::partition(prims.begin() + begin, prims.begin() + end, [=](const BVHPrimitive& p) {
+		return p.c[stretchedAxis] < axisMiddleCut;
+	});
 
 	// Ensure the partition is not degenerate : all primitives on the same side
-	unsigned int midIndex = (unsigned int)std::distance(pts.begin(), pmid);
+	int midIndex = int(std::distance(prims.begin(), pmid));
 	if (midIndex == begin || midIndex == end)
 		midIndex = (begin + end) / 2;
 
-	// Recursive construction of sub trees
-	TNode* left = BVHRecursive(pts, begin, midIndex);
-	TNode* right = BVHRecursive(pts, midIndex, end);
+	// Recursive construction of sub trees, large ones in parallel
+	TNode* left;
+	TNode* right;
+#pragma omp task shared(prims, left) if(end - begin > BVHTaskSize)
+	left = BVHMiddleRecursive(prims, begin, midIndex);
+	right = BVHMiddleRecursive(prims, midIndex, end);
+#pragma omp taskwait
 
 	// Blend of the two child nodes
 	return new TBlend(left, right);
 }
 
+static TNode* BVHBinnedSplit(std::vector<BVHPrimitive>&, int, int, int);
+
+// Bin of the volume cost heuristic
+struct BVHBin
+{
+	Vector3 a, b;	//!< %Box of the primitives.
+	float cost;		//!< Sum of the costs of the primitives.
+	int count;		//!< Number of primitives.
+};
+
+/*!
+\brief Create a bounding box hierarchy with a binned volume cost heuristic, see TTreeBVH::BVHBinned().
+\param prims Primitives, reordered.
+\param begin start index
+\param end end index
+*/
+static TNode* BVHBinnedRecursive(std::vector<BVHPrimitive>& prims, int begin, int end)
+{
+	const int Bins = TTreeBVH::Bins;
+
+	// If leaf, returns primitive
+	if (end - begin <= 1)
+		return prims[begin].node;
+
+	// Bounds of the centers of the primitives
+	Vector3 a = prims[begin].c, b = prims[begin].c;
+	for (int i = begin + 1; i < end; i++)
+	{
+		a = Vector3::Min(a, prims[i].c);
+		b = Vector3::Max(b, prims[i].c);
+	}
+
+	// Bin the primitives along the axis where their centers are the most spread, bins starting from an inverted box
+	const int k = (b - a).MaxIndex();
+	if (!(b[k] > a[k]))
+		return BVHBinnedSplit(prims, begin, (begin + end) / 2, end);
+	const float scale = Bins / (b[k] - a[k]);
+	const BVHBin empty = { Vector3(std::numeric_limits<float>::max()), Vector3(-std::numeric_limits<float>::max()), 0.0f, 0 };
+	BVHBin bins[Bins];
+	for (int j = 0; j < Bins; j++)
+		bins[j] = empty;
+	for (int i = begin; i < end; i++)
+	{
+		const BVHPrimitive& p = prims[i];
+		BVHBin& bin = bins[Math::Min(int((p.c[k] - a[k]) * scale), Bins - 1)];
+		bin.a = Vector3::Min(bin.a, p.box[0]);
+		bin.b = Vector3::Max(bin.b, p.box[1]);
+		bin.cost += p.cost;
+		bin.count++;
+	}
+
+	auto merge = [](BVHBin& sum, const BVHBin& bin) {
+		sum.a = Vector3::Min(sum.a, bin.a);
+		sum.b = Vector3::Max(sum.b, bin.b);
+		sum.cost += bin.cost;
+		sum.count += bin.count;
+	};
+
+	// Volumes weighted by costs of the bins on the right of every plane, skipping empty bins that would not change the split
+	float right[Bins];
+	BVHBin sum = empty;
+	right[Bins - 1] = 0.0f;
+	for (int j = Bins - 1; j > 0; j--)
+	{
+		if (bins[j].count == 0)
+		{
+			right[j - 1] = right[j];
+			continue;
+		}
+		merge(sum, bins[j]);
+		right[j - 1] = Box(sum.a, sum.b).Volume() * sum.cost;
+	}
+
+	// Sweep the planes from the left, right[j] being the cost of the bins after j.
+	// Queries are points, so the probability of visiting a child is the ratio of volumes and the
+	// expected cost of a split is V(L) C(L) + V(R) C(R), C being the sum of the costs of the primitives.
+	int plane = 0;
+	float best = std::numeric_limits<float>::max();
+	sum = empty;
+	for (int j = 0; j < Bins - 1 && sum.count + bins[j].count < end - begin; j++)
+	{
+		if (bins[j].count == 0)
+			continue;
+		merge(sum, bins[j]);
+		const float c = Box(sum.a, sum.b).Volume() * sum.cost + right[j];
+		if (c < best)
+		{
+			best = c;
+			plane = j + 1;
+		}
+	}
+
+	// Partition the primitives with respect to the best plane
+	const float lower = a[k];
+	auto pmid = std::partition(prims.begin() + begin, prims.begin() + end, [=](const BVHPrimitive& p) {
+		return Math::Min(int((p.c[k] - lower) * scale), Bins - 1) < plane;
+	});
+	int mid = int(std::distance(prims.begin(), pmid));
+	if (mid == begin || mid == end)
+		mid = (begin + end) / 2;
+	return BVHBinnedSplit(prims, begin, mid, end);
+}
+
+/*!
+\brief Create the blend of the hierarchies of two ranges of primitives.
+\param prims Primitives, reordered.
+\param begin start index
+\param mid start index of the second range
+\param end end index
+*/
+static TNode* BVHBinnedSplit(std::vector<BVHPrimitive>& prims, int begin, int mid, int end)
+{
+	// Recursive construction of sub trees, large ones in parallel
+	TNode* left;
+	TNode* right;
+#pragma omp task shared(prims, left) if(end - begin > BVHTaskSize)
+	left = BVHBinnedRecursive(prims, begin, mid);
+	right = BVHBinnedRecursive(prims, mid, end);
+#pragma omp taskwait
+
+	// Blend of the two child nodes
+	return new TBlend(left, right);
+}
+
+/*!
+\brief Create a bounding box hierarchy with a binned volume cost heuristic.
+
+Queries are points rather than rays, so the probability of visiting a node is the ratio of its volume to
+the volume of its parent, instead of the ratio of surface areas: splits minimize the sum over both sides
+of the volume of the box times the cost of the primitives, see TNode::Cost().
+
+Expensive primitives, such as cliffs, are isolated close to the root so that cheap
+primitives lying in their box are not merged with them.
+\param pts Primitives, reordered as the leaves of the hierarchy.
+\param begin start index
+\param end end index
+*/
+TNode* TTreeBVH::BVHBinned(std::vector<TNode*>& pts, unsigned int begin, unsigned int end)
+{
+	return BVHBuild(pts, begin, end, BVHBinnedRecursive);
+}
+
+/*!
+\brief Create a bounding box hierarchy by cutting nodes in the middle of their box.
+\param pts Primitives, reordered as the leaves of the hierarchy.
+\param begin start index
+\param end end index
+*/
+TNode* TTreeBVH::BVHRecursive(std::vector<TNode*>& pts, unsigned int begin, unsigned int end)
+{
+	return BVHBuild(pts, begin, end, BVHMiddleRecursive);
+}
+
 /*!
 \brief Recursive BVH Tree construction from a vector<TNode*>.
 \param begin start index
 \param end end index
+\param split Strategy splitting the nodes, the middle of the most stretched axis by default.
 */
-TNode* TTreeBVH::OptimizeHierarchy(std::vector<TNode*>& pts, unsigned int begin, unsigned int end)
+TNode* TTreeBVH::OptimizeHierarchy(std::vector<TNode*>& pts, unsigned int begin, unsigned int end, Split split)
 {
 	if (pts.empty())
 		return nullptr;
+	if (split == Split::VolumeCost)
+		return BVHBinned(pts, begin, end);
 	return BVHRecursive(pts, begin, end);
 }
+
+/*!
+\brief Collapse a binary hierarchy of blends into wide blends, so that a single node tests up to TWideBlend::Width boxes at once.
+
+The blends with the largest boxes are opened first, as they are the most likely to be traversed.
+Other nodes are left unchanged. Sub-trees keep their order, so that the intensity is summed in the
+same order as in the binary hierarchy.
+
+Wide blends cull every sub-tree with its own box, whereas a blend only culls with the union of the
+boxes: blends with a sub-tree that is not bounded by its box, see TNode::Bounded(), are kept and
+only their sub-trees are collapsed.
+\param node Root of the hierarchy, which is deleted and replaced.
+\return The new root.
+*/
+TNode* TTreeBVH::Collapse(TNode* node)
+{
+	TBlend* blend = dynamic_cast<TBlend*>(node);
+	if (blend == nullptr)
+		return node;
+	if (!blend->Bounded())
+	{
+		blend->e[0] = Collapse(blend->e[0]);
+		blend->e[1] = Collapse(blend->e[1]);
+		return blend;
+	}
+	return CollapseBounded(blend);
+}
+
+/*!
+\brief Collapse a hierarchy of blends whose sub-trees are all bounded by their box, see Collapse().
+\param node Root of the hierarchy, which is deleted and replaced.
+\return The new root.
+*/
+TNode* TTreeBVH::CollapseBounded(TNode* node)
+{
+	TBlend* blend = dynamic_cast<TBlend*>(node);
+	if (blend == nullptr)
+		return node;
+
+	// Open the blends with the largest boxes until the node is full
+	std::vector<TBlend*> opened = { blend };
+	std::vector<TNode*> children = { blend->e[0], blend->e[1] };
+	while (int(children.size()) < TWideBlend::Width)
+	{
+		int best = -1;
+		float volume = -1.0f;
+		for (int i = 0; i < int(children.size()); i++)
+		{
+			if (dynamic_cast<TBlend*>(children[i]) != nullptr && children[i]->GetBox().Volume() > volume)
+			{
+				best = i;
+				volume = children[i]->GetBox().Volume();
+			}
+		}
+		if (best < 0)
+			break;
+
+		TBlend* child = static_cast<TBlend*>(children[best]);
+		opened.push_back(child);
+		children[best] = child->e[0];
+		children.insert(children.begin() + best + 1, child->e[1]);
+	}
+
+	// Detach the sub-trees from the opened blends before deleting them
+	for (TBlend* b : opened)
+	{
+		b->e[0] = nullptr;
+		b->e[1] = nullptr;
+		delete b;
+	}
+
+	for (TNode*& child : children)
+		child = CollapseBounded(child);
+	return new TWideBlend(children.data(), int(children.size()));
+}
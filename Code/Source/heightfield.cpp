@@ -4,9 +4,23 @@
 
 #include <algorithm>
 #include <array>
+#include <cstdint>
+#include <cstring>
 #include <deque>
+#include <fstream>
 #include <queue>
 
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 /*
 \brief Main Class for representing 2D HeightField.
 */
@@ -77,3 +91,285 @@ ScalarField2D HeightField::Slope() const
 	}
 	return S;
 }
+
+/*!
+\brief Load elevations stored as raw little-endian floats, row after row, read as a single block.
+\param url File name.
+\param nx, ny Size of the grid.
+\param bbox Bounding box in world space.
+*/
+bool HeightField::LoadRaw(const char* url, int nx, int ny, const Box2D& bbox)
+{
+	std::ifstream in(url, std::ios::binary);
+	if (!in)
+		return false;
+
+	std::vector<float> data(size_t(nx) * size_t(ny));
+	in.read(reinterpret_cast<char*>(data.data()), data.size() * sizeof(float));
+	if (size_t(in.gcount()) != data.size() * sizeof(float))
+		return false;
+
+	this->nx = nx;
+	this->ny = ny;
+	box = bbox;
+	values.swap(data);
+	return true;
+}
+
+/*!
+\brief Load elevations stored as raw little-endian 16-bit unsigned integers, row after row.
+The file is read by blocks, converted in parallel to elevations in [a, b].
+\param url File name.
+\param nx, ny Size of the grid.
+\param bbox Bounding box in world space.
+\param a, b Elevations of the values 0 and 65535.
+*/
+bool HeightField::LoadRaw16(const char* url, int nx, int ny, const Box2D& bbox, float a, float b)
+{
+	std::ifstream in(url, std::ios::binary);
+	if (!in)
+		return false;
+
+	const size_t size = size_t(nx) * size_t(ny);
+	std::vector<float> data(size);
+	std::vector<uint16_t> buffer(1 << 21);
+	const float scale = (b - a) / 65535.0f;
+	for (size_t k = 0; k < size; k += buffer.size())
+	{
+		const int m = int(std::min(buffer.size(), size - k));
+		in.read(reinterpret_cast<char*>(buffer.data()), m * sizeof(uint16_t));
+		if (in.gcount() != std::streamsize(m * sizeof(uint16_t)))
+			return false;
+#pragma omp parallel for
+		for (int i = 0; i < m; i++)
+			data[k + i] = a + scale * float(buffer[i]);
+	}
+
+	this->nx = nx;
+	this->ny = ny;
+	box = bbox;
+	values.swap(data);
+	return true;
+}
+
+
+/*!
+\class TiledHeightField heightfield.h
+\brief Heightfield stored by tiles in a file mapped in memory, for grids larger than the memory.
+
+Tiles are square blocks of samples stored one after the other, so that a neighborhood of the grid
+only spans a few pages of the file. Tiles on the borders are padded by repeating the last samples.
+*/
+
+// Header of the tiled format, the tiles being stored from TiledOffset on
+struct TiledHeader
+{
+	char magic[4];		// "ITHF"
+	uint32_t version;	// 1
+	int32_t nx, ny;		// Size of the grid
+	int32_t shift;		// Size of the tiles, as a power of two
+	float box[4];		// Bounding box
+};
+
+// Offset of the tiles in the file, aligned on pages
+static const size_t TiledOffset = 4096;
+
+/*!
+\brief Create an empty heightfield, which should be opened.
+*/
+TiledHeightField::TiledHeightField() : nx(0), ny(0), shift(0), tx(0), values(nullptr), file(nullptr), mapping(nullptr), length(0)
+{
+}
+
+/*!
+\brief Unmap the file.
+*/
+TiledHeightField::~TiledHeightField()
+{
+	Close();
+}
+
+/*!
+\brief Map a file written by Create().
+\param url File name.
+*/
+bool TiledHeightField::Open(const char* url)
+{
+	Close();
+
+#ifdef _WIN32
+	HANDLE f = CreateFileA(url, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, nullptr);
+	if (f == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER size;
+	HANDLE m = GetFileSizeEx(f, &size) ? CreateFileMappingA(f, nullptr, PAGE_READONLY, 0, 0, nullptr) : nullptr;
+	void* view = m != nullptr ? MapViewOfFile(m, FILE_MAP_READ, 0, 0, 0) : nullptr;
+	if (view == nullptr)
+	{
+		if (m != nullptr)
+			CloseHandle(m);
+		CloseHandle(f);
+		return false;
+	}
+	CloseHandle(m);
+	file = f;
+	length = size_t(size.QuadPart);
+#else
+	const int f = open(url, O_RDONLY);
+	if (f < 0)
+		return false;
+	struct stat st;
+	void* view = fstat(f, &st) == 0 && st.st_size > 0 ? mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_SHARED, f, 0) : MAP_FAILED;
+	close(f);
+	if (view == MAP_FAILED)
+		return false;
+	length = size_t(st.st_size);
+#endif
+	mapping = view;
+
+	// Check the header and the size of the file
+	TiledHeader header;
+	bool valid = length >= TiledOffset;
+	if (valid)
+	{
+		memcpy(&header, mapping, sizeof(header));
+		valid = memcmp(header.magic, "ITHF", 4) == 0 && header.version == 1 && header.nx > 1 && header.ny > 1 && header.shift >= 0 && header.shift < 16;
+	}
+	if (valid)
+	{
+		const size_t t = size_t(1) << header.shift;
+		const size_t tiles = ((size_t(header.nx) + t - 1) >> header.shift) * ((size_t(header.ny) + t - 1) >> header.shift);
+		valid = length >= TiledOffset + tiles * t * t * sizeof(float);
+	}
+	if (!valid)
+	{
+		Close();
+		return false;
+	}
+
+	nx = header.nx;
+	ny = header.ny;
+	shift = header.shift;
+	tx = (nx + (1 << shift) - 1) >> shift;
+	box = Box2D(Vector2(header.box[0], header.box[1]), Vector2(header.box[2], header.box[3]));
+	values = reinterpret_cast<const float*>(static_cast<const char*>(mapping) + TiledOffset);
+	return true;
+}
+
+/*!
+\brief Unmap the file.
+*/
+void TiledHeightField::Close()
+{
+	if (mapping != nullptr)
+	{
+#ifdef _WIN32
+		UnmapViewOfFile(mapping);
+		CloseHandle(file);
+#else
+		munmap(mapping, length);
+#endif
+	}
+	file = nullptr;
+	mapping = nullptr;
+	values = nullptr;
+	length = 0;
+	nx = ny = tx = 0;
+}
+
+/*!
+\brief Write the header of a tiled file.
+\return The size of the tiles as a power of two, or -1 if the tile size is not a power of two.
+*/
+static int WriteTiledHeader(std::ofstream& out, int nx, int ny, const Box2D& bbox, int tile)
+{
+	int shift = 0;
+	while ((1 << shift) < tile)
+		shift++;
+	if ((1 << shift) != tile || nx < 2 || ny < 2)
+		return -1;
+
+	TiledHeader header = { { 'I', 'T', 'H', 'F' }, 1, nx, ny, shift, { bbox[0][0], bbox[0][1], bbox[1][0], bbox[1][1] } };
+	std::vector<char> page(TiledOffset, 0);
+	memcpy(page.data(), &header, sizeof(header));
+	out.write(page.data(), page.size());
+	return shift;
+}
+
+/*!
+\brief Write a row of tiles.
+\param out Stream.
+\param rows Rows of samples covered by the tiles, at most the size of the tiles.
+\param n Number of rows.
+\param nx Size of the rows.
+\param tile Size of the tiles.
+*/
+static void WriteTileRow(std::ofstream& out, const std::vector<float>& rows, int n, int nx, int tile)
+{
+	std::vector<float> block(size_t(tile) * tile);
+	for (int u = 0; u < nx; u += tile)
+	{
+		for (int i = 0; i < tile; i++)
+		{
+			const float* row = rows.data() + size_t(std::min(i, n - 1)) * nx;
+			for (int j = 0; j < tile; j++)
+				block[size_t(i) * tile + j] = row[std::min(u + j, nx - 1)];
+		}
+		out.write(reinterpret_cast<const char*>(block.data()), block.size() * sizeof(float));
+	}
+}
+
+/*!
+\brief Write a field in the tiled format.
+\param url File name.
+\param field Field.
+\param tile Size of the tiles, a power of two.
+*/
+bool TiledHeightField::Create(const char* url, const ScalarField2D& field, int tile)
+{
+	std::ofstream out(url, std::ios::binary);
+	const int nx = field.SizeX();
+	const int ny = field.SizeY();
+	if (!out || WriteTiledHeader(out, nx, ny, Box2D(field.BottomLeft(), field.TopRight()), tile) < 0)
+		return false;
+
+	std::vector<float> rows(size_t(tile) * nx);
+	for (int v = 0; v < ny; v += tile)
+	{
+		const int n = std::min(tile, ny - v);
+		for (int i = 0; i < n; i++)
+			for (int j = 0; j < nx; j++)
+				rows[size_t(i) * nx + j] = field.Get(v + i, j);
+		WriteTileRow(out, rows, n, nx, tile);
+	}
+	return bool(out);
+}
+
+/*!
+\brief Convert elevations stored as raw little-endian floats, row after row, to the tiled format.
+The raw file is streamed one row of tiles at a time, so that grids larger than the memory can be converted.
+\param url File name.
+\param raw Raw file name.
+\param nx, ny Size of the grid.
+\param bbox Bounding box in world space.
+\param tile Size of the tiles, a power of two.
+*/
+bool TiledHeightField::Create(const char* url, const char* raw, int nx, int ny, const Box2D& bbox, int tile)
+{
+	std::ifstream in(raw, std::ios::binary);
+	std::ofstream out(url, std::ios::binary);
+	if (!in || !out || WriteTiledHeader(out, nx, ny, bbox, tile) < 0)
+		return false;
+
+	std::vector<float> rows(size_t(tile) * nx);
+	for (int v = 0; v < ny; v += tile)
+	{
+		const int n = std::min(tile, ny - v);
+		const std::streamsize size = std::streamsize(n) * nx * sizeof(float);
+		in.read(reinterpret_cast<char*>(rows.data()), size);
+		if (in.gcount() != size)
+			return false;
+		WriteTileRow(out, rows, n, nx, tile);
+	}
+	return bool(out);
+}
@@ -74,20 +74,28 @@ of our model in modelling volumetric landforms automatically (and hopefully, fas
 \param tree terrain construction tree
 \param geoTree geology construction tree
 \param featurePositions resurgence point array computed by GetFeatureLocationKarsts().
+\param segments Emit a chain of segments joining every seed to the seed it originates from, instead of a cluster of vertices around every seed.
 \returns a vector of nodes to combine with the base construction tree.
 */
-static std::vector<TNode*> KarstInvasionPercolation(TTree* tree, GeoTree* geoTree, std::vector<Vector3>& featurePositions)
+static std::vector<TNode*> KarstInvasionPercolation(TTree* tree, GeoTree* geoTree, std::vector<Vector3>& featurePositions, bool segments)
 {
+	// Seed, with the position of the seed it originates from
+	struct IPSeed
+	{
+		Vector3 p;
+		Vector3 parent;
+	};
+
 	// Utility structure to sort the candidate position std::vector.
 	// Compare rock hardness of the two candidates.
 	struct IPSeedSortingPredicate
 	{
 	public:
 		GeoTree * geoTree;
-		bool operator()(Vector3 a, Vector3 b) const
+		bool operator()(const IPSeed& a, const IPSeed& b) const
 		{
-			float hardnessA = geoTree->Intensity(a);
-			float hardnessB = geoTree->Intensity(b);
+			float hardnessA = geoTree->Intensity(a.p);
+			float hardnessB = geoTree->Intensity(b.p);
 			return hardnessA < hardnessB;
 		}
 	};
@@ -99,6 +107,8 @@ static std::vector<TNode*> KarstInvasionPercolation(TTree* tree, GeoTree* geoTre
 	const float step = radius / 1.5f;
 	const float breakingProbablity = 0.15f;
 	const Vector2 altitudeRange = Vector2(-10.0, 40.0f);
+	const float segmentRadius = 12.0f;
+	const float segmentEnergy = -24.0f;
 
 	IPSeedSortingPredicate predicate;
 	predicate.geoTree = geoTree;
@@ -106,13 +116,20 @@ static std::vector<TNode*> KarstInvasionPercolation(TTree* tree, GeoTree* geoTre
 	std::vector<TNode*> ret;
 	std::vector<Vector3> poissonSampling;
 
+	// Initial seeds start the chains
+	std::vector<IPSeed> seeds;
+	for (const Vector3& p : featurePositions)
+		seeds.push_back({ p, p });
+	featurePositions.clear();
+
 	// You can also put a limited number of iteration, as this may take a while to converge if
 	// You put too many sample in the neighbour computation step.
-	while (featurePositions.empty() == false)
+	while (seeds.empty() == false)
 	{
 		// Pop the softest seed and try to dig a karst from there
-		Vector3 p = featurePositions[0];
-		featurePositions.erase(featurePositions.begin());
+		Vector3 p = seeds[0].p;
+		Vector3 parent = seeds[0].parent;
+		seeds.erase(seeds.begin());
 
 		// Break rule before everything: random probability
 		// Not having this condition means that the karstification
@@ -130,42 +147,51 @@ static std::vector<TNode*> KarstInvasionPercolation(TTree* tree, GeoTree* geoTre
 			continue;
 		poissonSampling.push_back(p);
 
-		// Place multiple primitives whose radius is changed by a geology factor
-		// Sample inside a sphere. We do this to create a more complex effect on the
-		// Karst structure: having just one big primitive at each position doesn't lead
-		// To good looking karsts.
-		std::vector<Vector3> smallPoisson;
-		Sphere smallSphere = Sphere(p, radius / 2.0);
-		float smallRadius = radius / 2.0;
-		for (int i = 0; i < 40; i++)
+		// A single segment from the parent seed, whose radius and energy are changed by a geology factor
+		if (segments)
+		{
+			float geoFactor = Math::Clamp(1.0f - Math::Clamp(geoTree->Intensity(p)), 0.85f, 1.0f);
+			ret.push_back(new TSegment(parent, p, segmentRadius * geoFactor, segmentEnergy * geoFactor));
+		}
+		else
 		{
-			// Sample inside a small sphere
-			Vector3 pp = smallSphere.RandomInside();
+			// Place multiple primitives whose radius is changed by a geology factor
+			// Sample inside a sphere. We do this to create a more complex effect on the
+			// Karst structure: having just one big primitive at each position doesn't lead
+			// To good looking karsts.
+			std::vector<Vector3> smallPoisson;
+			Sphere smallSphere = Sphere(p, radius / 2.0);
+			float smallRadius = radius / 2.0;
+			for (int i = 0; i < 40; i++)
+			{
+				// Sample inside a small sphere
+				Vector3 pp = smallSphere.RandomInside();
 
-			// Poisson sphere criteria
-			if (PoissonSphereCheck(pp, smallPoisson, smallRadius / 2.5f))
-				continue;
+				// Poisson sphere criteria
+				if (PoissonSphereCheck(pp, smallPoisson, smallRadius / 2.5f))
+					continue;
 
-			// Compute the geology factor (softness) at pp
-			float geoFactor = 1.0f - Math::Clamp(geoTree->Intensity(pp));
+				// Compute the geology factor (softness) at pp
+				float geoFactor = 1.0f - Math::Clamp(geoTree->Intensity(pp));
 
-			// If rock is too hard
-			if (geoFactor < 0.3f)
-			{
-				float smallProba = Random::Uniform();
-				if (smallProba < 0.05f) // 5% chance of karst in hard rock.
-					continue;
-			}
+				// If rock is too hard
+				if (geoFactor < 0.3f)
+				{
+					float smallProba = Random::Uniform();
+					if (smallProba < 0.05f) // 5% chance of karst in hard rock.
+						continue;
+				}
 
-			// Modulate energy & radius with geology
-			// Radius & Energy can't be too low, so we clamp the geoFactor to something acceptable.
-			geoFactor = Math::Clamp(geoFactor, 0.85f, 1.0f);
+				// Modulate energy & radius with geology
+				// Radius & Energy can't be too low, so we clamp the geoFactor to something acceptable.
+				geoFactor = Math::Clamp(geoFactor, 0.85f, 1.0f);
 
-			// Add the primitive
-			float actualRadius = smallRadius * geoFactor;
-			float actualEnergy = energy * geoFactor;
-			ret.push_back(new TVertex(pp, actualRadius, actualEnergy));
-			smallPoisson.push_back(pp);
+				// Add the primitive
+				float actualRadius = smallRadius * geoFactor;
+				float actualEnergy = energy * geoFactor;
+				ret.push_back(new TVertex(pp, actualRadius, actualEnergy));
+				smallPoisson.push_back(pp);
+			}
 		}
 
 		// Break rule after primitives: random probability again
@@ -175,11 +201,11 @@ static std::vector<TNode*> KarstInvasionPercolation(TTree* tree, GeoTree* geoTre
 
 		// Neighborhood is composed of 2 random point sampled in the unit circle, with y in [-0.2, 0.2]
 		// You can put more of course, at the expense of computation time.
-		featurePositions.push_back(p + Circle2(Vector2(0), 1).RandomOn().ToVector3(Random::Uniform(-0.2f, 0.2f)) * step);
-		featurePositions.push_back(p + Circle2(Vector2(0), 1).RandomOn().ToVector3(Random::Uniform(-0.2f, 0.2f)) * step);
+		seeds.push_back({ p + Circle2(Vector2(0), 1).RandomOn().ToVector3(Random::Uniform(-0.2f, 0.2f)) * step, p });
+		seeds.push_back({ p + Circle2(Vector2(0), 1).RandomOn().ToVector3(Random::Uniform(-0.2f, 0.2f)) * step, p });
 
 		// Re-sort all the seed by decreasing rock hardness
-		std::sort(featurePositions.begin(), featurePositions.end(), predicate);
+		std::sort(seeds.begin(), seeds.end(), predicate);
 	}
 	std::cout << "Total primitive count : " << ret.size() << std::endl;
 	return ret;
@@ -187,17 +213,21 @@ static std::vector<TNode*> KarstInvasionPercolation(TTree* tree, GeoTree* geoTre
 
 /*!
 \brief Entry point of the Karst scene.
+\param segments Dig the karst network with chains of segments instead of clusters of vertices.
+\return the terrain tree.
 */
-void KarstScene()
+TTree* KarstScene(bool segments)
 {
-	// Terrain Tree
+	// Terrain Tree, whose nodes are allocated from its arena
 	const float sizeX = 400.0f;
 	const float sizeY = 400.0f;
 	const float minAlt = -20.0f;
 	const float maxAlt = 70.0f;
 	const Box2D bbox = Box2D(Vector2(-sizeY / 2.0, -sizeX / 2.0), Vector2(sizeY / 2.0, sizeX / 2.0));
+	TArena* arena = new TArena;
+	TArena::Scope scope(arena);
 	TAnalyticCliff* root = new TAnalyticCliff(bbox.ToBox(minAlt, maxAlt), Vector2(minAlt, maxAlt));
-	TTree* terrainTree = new TTree(root);
+	TTree* terrainTree = new TTree(root, arena);
 	HeightField hf = HeightField(root, 256, 256, bbox);
 
 	// Geology Tree
@@ -217,12 +247,11 @@ void KarstScene()
 	std::cout << "Karst Invasion-Percolation" << std::endl;
 	{
 		std::vector<Vector3> featurePositions = GetInitialSeeds(hf);
-		std::vector<TNode*> nodes = KarstInvasionPercolation(terrainTree, geoTree, featurePositions);
+		std::vector<TNode*> nodes = KarstInvasionPercolation(terrainTree, geoTree, featurePositions, segments);
 		if (nodes.size() > 0)
-			terrainTree->Blend(TTreeBVH::OptimizeHierarchy(nodes, 0, int(nodes.size())));
+			terrainTree->Blend(TTreeBVH::Collapse(TTreeBVH::OptimizeHierarchy(nodes, 0, int(nodes.size()))));
 	}
 
-	// Export
-	marching_cube("karst.obj", terrainTree, 200);
 	std::cout << std::endl;
+	return terrainTree;
 }
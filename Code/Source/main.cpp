@@ -10,23 +10,96 @@
 	axel(dot)paris(at)liris(dot)cnrs(dot)fr
 */
 
-void SeaScene();
-void KarstScene();
-void FloatingIsland();
+#include "ttree.h"
+#include "mc.h"
+
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+TTree* SeaScene();
+TTree* KarstScene(bool segments = false);
+TTree* FloatingIsland();
+int Benchmark(const char* name, const TTree* tree, int n);
+void BenchmarkBVH(int n);
+void BenchmarkVertexCloud(int n);
+void BenchmarkArena(int n);
+int BenchmarkTerrainCache(int n);
+int BenchmarkHeightField(int n);
+int BenchmarkTiledHeightField(int n);
+int BenchmarkQuadtree(int n);
 
 /*!
 \brief Running this program will export some
 meshes similar to the ones seen in the paper. Each scene
 is in its own file and contains all the algorithms necessary
 to reproduce it.
+
+Running it with the "benchmark" argument times the field function of
+the scenes and compares the hierarchy builders instead of exporting them,
+and exits with a non-zero status if any of their checks fails.
 */
-int main()
+int main(int argc, char** argv)
 {
-	SeaScene();
+	// Scenes are built one after the other, as they draw from the same random sequence
+	TTree* trees[3];
+	trees[0] = SeaScene();
+	trees[1] = FloatingIsland();
+	trees[2] = KarstScene();
+	const char* names[3] = { "sea", "islands", "karst" };
+
+	if (argc > 1 && strcmp(argv[1], "benchmark") == 0)
+	{
+		int failures = 0;
+		for (int i = 0; i < 3; i++)
+			failures += Benchmark(names[i], trees[i], 1000000);
+		BenchmarkBVH(200000);
+		BenchmarkVertexCloud(200000);
+		BenchmarkArena(200000);
+		failures += BenchmarkTerrainCache(1000000);
+		failures += BenchmarkHeightField(200000);
+		failures += BenchmarkTiledHeightField(200000);
+		failures += BenchmarkQuadtree(10000);
+		for (int i = 0; i < 3; i++)
+			delete trees[i];
+
+		// Karst network dug with segments
+		TTree* segments = KarstScene(true);
+		failures += Benchmark("karst segments", segments, 1000000);
+		delete segments;
+		if (failures != 0)
+			std::cout << failures << " failed checks" << std::endl;
+		return failures != 0 ? 1 : 0;
+	}
 
-	FloatingIsland();
+	// Polygonize the scenes concurrently, with one mesher each sharing the available cores
+	const char* urls[3] = { "sea.obj", "islands.obj", "karst.obj" };
+	const int res[3] = { 350, 100, 200 };
+	int threads = 1;
+#ifdef _OPENMP
+	omp_set_nested(1);
+	threads = omp_get_max_threads() / 3 > 1 ? omp_get_max_threads() / 3 : 1;
+#endif
+#pragma omp parallel for num_threads(3)
+	for (int i = 0; i < 3; i++)
+	{
+		Mesher mesher;
+		mesher.SetThreads(threads);
+		mesher.Polygonize(trees[i], res[i]);
+		mesher.Export(urls[i]);
 
-	KarstScene();
+		// Single write, so that concurrent meshers do not interleave their messages
+		std::ostringstream message;
+		message << "Marching cubes " << names[i] << ": " << mesher.Time() << " ms (" << threads << " threads, "
+			<< 100.0 * double(mesher.Evaluations()) / double(mesher.Voxels()) << "% of dense evaluations)\n";
+		std::cout << message.str() << std::flush;
+	}
 
+	for (int i = 0; i < 3; i++)
+		delete trees[i];
 	return 0;
 }
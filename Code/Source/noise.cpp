@@ -0,0 +1,329 @@
+#include "noise.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define NOISE_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// Functions compiled for an instruction set that may be missing from the build flags
+#if defined(NOISE_X86) && defined(__GNUC__)
+#define NOISE_TARGET(s) __attribute__((target(s)))
+#else
+#define NOISE_TARGET(s)
+#endif
+
+/*
+	Packet versions of the Perlin noise. The kernels perform the same floating point operations
+	as PerlinNoise::GetValue(): gradients are selected with masks instead of branches, and the
+	fading function is computed in double precision, as the scalar version does through pow().
+	Both return the same values up to rounding, as the compiler may fuse the multiplications
+	and additions of the scalar version.
+*/
+
+// Points processed by a kernel call
+static const int NoiseBlock = 8;
+
+typedef void (*NoiseKernel)(const float* x, const float* y, const float* z, float* v);
+
+/*!
+\brief Scalar kernel, used when no vector instruction set is available.
+*/
+static void NoiseScalar(const float* x, const float* y, const float* z, float* v)
+{
+	for (int i = 0; i < NoiseBlock; i++)
+		v[i] = PerlinNoise::GetValue(Vector3(x[i], y[i], z[i]));
+}
+
+#ifdef NOISE_X86
+
+// Four-wide helpers
+NOISE_TARGET("sse4.1")
+static inline __m128 FadeSSE4(__m128 t)
+{
+	const __m128 s = _mm_add_ps(_mm_mul_ps(t, _mm_sub_ps(_mm_mul_ps(t, _mm_set1_ps(6.0f)), _mm_set1_ps(15.0f))), _mm_set1_ps(10.0f));
+	const __m128d tl = _mm_cvtps_pd(t);
+	const __m128d th = _mm_cvtps_pd(_mm_movehl_ps(t, t));
+	const __m128d fl = _mm_mul_pd(_mm_mul_pd(_mm_mul_pd(tl, tl), tl), _mm_cvtps_pd(s));
+	const __m128d fh = _mm_mul_pd(_mm_mul_pd(_mm_mul_pd(th, th), th), _mm_cvtps_pd(_mm_movehl_ps(s, s)));
+	return _mm_movelh_ps(_mm_cvtpd_ps(fl), _mm_cvtpd_ps(fh));
+}
+
+NOISE_TARGET("sse4.1")
+static inline __m128 GradientSSE4(__m128i hash, __m128 x, __m128 y, __m128 z)
+{
+	const __m128i h = _mm_and_si128(hash, _mm_set1_epi32(15));
+	const __m128 lt8 = _mm_castsi128_ps(_mm_cmplt_epi32(h, _mm_set1_epi32(8)));
+	const __m128 lt4 = _mm_castsi128_ps(_mm_cmplt_epi32(h, _mm_set1_epi32(4)));
+	const __m128 hx = _mm_castsi128_ps(_mm_or_si128(_mm_cmpeq_epi32(h, _mm_set1_epi32(12)), _mm_cmpeq_epi32(h, _mm_set1_epi32(14))));
+	const __m128 u = _mm_blendv_ps(y, x, lt8);
+	const __m128 v = _mm_blendv_ps(_mm_blendv_ps(z, x, hx), y, lt4);
+	const __m128 su = _mm_castsi128_ps(_mm_slli_epi32(h, 31));
+	const __m128 sv = _mm_castsi128_ps(_mm_slli_epi32(_mm_srli_epi32(h, 1), 31));
+	return _mm_add_ps(_mm_xor_ps(u, su), _mm_xor_ps(v, sv));
+}
+
+NOISE_TARGET("sse4.1")
+static inline __m128 LerpSSE4(__m128 a, __m128 b, __m128 t)
+{
+	return _mm_add_ps(_mm_mul_ps(a, _mm_sub_ps(_mm_set1_ps(1.0f), t)), _mm_mul_ps(b, t));
+}
+
+/*!
+\brief Four-wide kernel, lookups into the permutation table are scalar.
+*/
+NOISE_TARGET("sse4.1")
+static void NoiseSSE4(const float* px, const float* py, const float* pz, float* out)
+{
+	for (int k = 0; k < NoiseBlock; k += 4)
+	{
+		__m128 x = _mm_loadu_ps(px + k);
+		__m128 y = _mm_loadu_ps(py + k);
+		__m128 z = _mm_loadu_ps(pz + k);
+
+		// Unit coordinates in cube
+		const __m128 fx = _mm_floor_ps(x);
+		const __m128 fy = _mm_floor_ps(y);
+		const __m128 fz = _mm_floor_ps(z);
+		alignas(16) int ux[4], uy[4], uz[4];
+		const __m128i mask = _mm_set1_epi32(255);
+		_mm_store_si128((__m128i*)ux, _mm_and_si128(_mm_cvttps_epi32(fx), mask));
+		_mm_store_si128((__m128i*)uy, _mm_and_si128(_mm_cvttps_epi32(fy), mask));
+		_mm_store_si128((__m128i*)uz, _mm_and_si128(_mm_cvttps_epi32(fz), mask));
+
+		// Relative coordinates in cube
+		x = _mm_sub_ps(x, fx);
+		y = _mm_sub_ps(y, fy);
+		z = _mm_sub_ps(z, fz);
+
+		// Compute fading coefficients
+		const __m128 u = FadeSSE4(x);
+		const __m128 v = FadeSSE4(y);
+		const __m128 w = FadeSSE4(z);
+
+		// Hash cube coordinates
+		alignas(16) int h[8][4];
+		for (int i = 0; i < 4; i++)
+		{
+			const int a = Perm[ux[i]] + uy[i];
+			const int aa = Perm[a] + uz[i];
+			const int ab = Perm[a + 1] + uz[i];
+			const int b = Perm[ux[i] + 1] + uy[i];
+			const int ba = Perm[b] + uz[i];
+			const int bb = Perm[b + 1] + uz[i];
+			h[0][i] = Perm[aa];
+			h[1][i] = Perm[ba];
+			h[2][i] = Perm[ab];
+			h[3][i] = Perm[bb];
+			h[4][i] = Perm[aa + 1];
+			h[5][i] = Perm[ba + 1];
+			h[6][i] = Perm[ab + 1];
+			h[7][i] = Perm[bb + 1];
+		}
+		__m128i g[8];
+		for (int i = 0; i < 8; i++)
+			g[i] = _mm_load_si128((const __m128i*)h[i]);
+
+		const __m128 one = _mm_set1_ps(1.0f);
+		const __m128 x1 = _mm_sub_ps(x, one);
+		const __m128 y1 = _mm_sub_ps(y, one);
+		const __m128 z1 = _mm_sub_ps(z, one);
+
+		// Interpolate results
+		const __m128 l1 = LerpSSE4(GradientSSE4(g[0], x, y, z), GradientSSE4(g[1], x1, y, z), u);
+		const __m128 l2 = LerpSSE4(GradientSSE4(g[2], x, y1, z), GradientSSE4(g[3], x1, y1, z), u);
+		const __m128 l3 = LerpSSE4(GradientSSE4(g[4], x, y, z1), GradientSSE4(g[5], x1, y, z1), u);
+		const __m128 l4 = LerpSSE4(GradientSSE4(g[6], x, y1, z1), GradientSSE4(g[7], x1, y1, z1), u);
+		const __m128 l5 = LerpSSE4(l1, l2, v);
+		const __m128 l6 = LerpSSE4(l3, l4, v);
+		_mm_storeu_ps(out + k, LerpSSE4(l5, l6, w));
+	}
+}
+
+// Eight-wide helpers
+NOISE_TARGET("avx2")
+static inline __m256 FadeAVX2(__m256 t)
+{
+	const __m256 s = _mm256_add_ps(_mm256_mul_ps(t, _mm256_sub_ps(_mm256_mul_ps(t, _mm256_set1_ps(6.0f)), _mm256_set1_ps(15.0f))), _mm256_set1_ps(10.0f));
+	const __m256d tl = _mm256_cvtps_pd(_mm256_castps256_ps128(t));
+	const __m256d th = _mm256_cvtps_pd(_mm256_extractf128_ps(t, 1));
+	const __m256d fl = _mm256_mul_pd(_mm256_mul_pd(_mm256_mul_pd(tl, tl), tl), _mm256_cvtps_pd(_mm256_castps256_ps128(s)));
+	const __m256d fh = _mm256_mul_pd(_mm256_mul_pd(_mm256_mul_pd(th, th), th), _mm256_cvtps_pd(_mm256_extractf128_ps(s, 1)));
+	return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm256_cvtpd_ps(fl)), _mm256_cvtpd_ps(fh), 1);
+}
+
+NOISE_TARGET("avx2")
+static inline __m256i PermAVX2(__m256i i)
+{
+	return _mm256_i32gather_epi32(Perm, i, 4);
+}
+
+NOISE_TARGET("avx2")
+static inline __m256 GradientAVX2(__m256i hash, __m256 x, __m256 y, __m256 z)
+{
+	const __m256i h = _mm256_and_si256(hash, _mm256_set1_epi32(15));
+	const __m256 lt8 = _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32(8), h));
+	const __m256 lt4 = _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32(4), h));
+	const __m256 hx = _mm256_castsi256_ps(_mm256_or_si256(_mm256_cmpeq_epi32(h, _mm256_set1_epi32(12)), _mm256_cmpeq_epi32(h, _mm256_set1_epi32(14))));
+	const __m256 u = _mm256_blendv_ps(y, x, lt8);
+	const __m256 v = _mm256_blendv_ps(_mm256_blendv_ps(z, x, hx), y, lt4);
+	const __m256 su = _mm256_castsi256_ps(_mm256_slli_epi32(h, 31));
+	const __m256 sv = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_srli_epi32(h, 1), 31));
+	return _mm256_add_ps(_mm256_xor_ps(u, su), _mm256_xor_ps(v, sv));
+}
+
+NOISE_TARGET("avx2")
+static inline __m256 LerpAVX2(__m256 a, __m256 b, __m256 t)
+{
+	return _mm256_add_ps(_mm256_mul_ps(a, _mm256_sub_ps(_mm256_set1_ps(1.0f), t)), _mm256_mul_ps(b, t));
+}
+
+/*!
+\brief Eight-wide kernel, lookups into the permutation table are gathered.
+*/
+NOISE_TARGET("avx2")
+static void NoiseAVX2(const float* px, const float* py, const float* pz, float* out)
+{
+	__m256 x = _mm256_loadu_ps(px);
+	__m256 y = _mm256_loadu_ps(py);
+	__m256 z = _mm256_loadu_ps(pz);
+
+	// Unit coordinates in cube
+	const __m256 fx = _mm256_floor_ps(x);
+	const __m256 fy = _mm256_floor_ps(y);
+	const __m256 fz = _mm256_floor_ps(z);
+	const __m256i mask = _mm256_set1_epi32(255);
+	const __m256i ux = _mm256_and_si256(_mm256_cvttps_epi32(fx), mask);
+	const __m256i uy = _mm256_and_si256(_mm256_cvttps_epi32(fy), mask);
+	const __m256i uz = _mm256_and_si256(_mm256_cvttps_epi32(fz), mask);
+
+	// Relative coordinates in cube
+	x = _mm256_sub_ps(x, fx);
+	y = _mm256_sub_ps(y, fy);
+	z = _mm256_sub_ps(z, fz);
+
+	// Compute fading coefficients
+	const __m256 u = FadeAVX2(x);
+	const __m256 v = FadeAVX2(y);
+	const __m256 w = FadeAVX2(z);
+
+	// Hash cube coordinates
+	const __m256i one = _mm256_set1_epi32(1);
+	const __m256i a = _mm256_add_epi32(PermAVX2(ux), uy);
+	const __m256i aa = _mm256_add_epi32(PermAVX2(a), uz);
+	const __m256i ab = _mm256_add_epi32(PermAVX2(_mm256_add_epi32(a, one)), uz);
+	const __m256i b = _mm256_add_epi32(PermAVX2(_mm256_add_epi32(ux, one)), uy);
+	const __m256i ba = _mm256_add_epi32(PermAVX2(b), uz);
+	const __m256i bb = _mm256_add_epi32(PermAVX2(_mm256_add_epi32(b, one)), uz);
+
+	const __m256 x1 = _mm256_sub_ps(x, _mm256_set1_ps(1.0f));
+	const __m256 y1 = _mm256_sub_ps(y, _mm256_set1_ps(1.0f));
+	const __m256 z1 = _mm256_sub_ps(z, _mm256_set1_ps(1.0f));
+
+	// Interpolate results
+	const __m256 l1 = LerpAVX2(GradientAVX2(PermAVX2(aa), x, y, z), GradientAVX2(PermAVX2(ba), x1, y, z), u);
+	const __m256 l2 = LerpAVX2(GradientAVX2(PermAVX2(ab), x, y1, z), GradientAVX2(PermAVX2(bb), x1, y1, z), u);
+	const __m256 l3 = LerpAVX2(GradientAVX2(PermAVX2(_mm256_add_epi32(aa, one)), x, y, z1), GradientAVX2(PermAVX2(_mm256_add_epi32(ba, one)), x1, y, z1), u);
+	const __m256 l4 = LerpAVX2(GradientAVX2(PermAVX2(_mm256_add_epi32(ab, one)), x, y1, z1), GradientAVX2(PermAVX2(_mm256_add_epi32(bb, one)), x1, y1, z1), u);
+	const __m256 l5 = LerpAVX2(l1, l2, v);
+	const __m256 l6 = LerpAVX2(l3, l4, v);
+	_mm256_storeu_ps(out, LerpAVX2(l5, l6, w));
+}
+
+#endif
+
+/*!
+\brief Select the widest kernel supported by the processor.
+*/
+static NoiseKernel SelectKernel()
+{
+#if defined(NOISE_X86) && defined(__GNUC__)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		return NoiseAVX2;
+	if (__builtin_cpu_supports("sse4.1"))
+		return NoiseSSE4;
+#elif defined(NOISE_X86) && defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	const int ids = info[0];
+	__cpuid(info, 1);
+	const bool sse41 = (info[2] & (1 << 19)) != 0;
+	const bool avx = (info[2] & (1 << 28)) != 0 && (info[2] & (1 << 27)) != 0 && (_xgetbv(0) & 6) == 6;
+	bool avx2 = false;
+	if (ids >= 7)
+	{
+		__cpuidex(info, 7, 0);
+		avx2 = avx && (info[1] & (1 << 5)) != 0;
+	}
+	if (avx2)
+		return NoiseAVX2;
+	if (sse41)
+		return NoiseSSE4;
+#endif
+	return NoiseScalar;
+}
+
+static const NoiseKernel Kernel = SelectKernel();
+
+/*!
+\brief Compute the noise at a set of points, with the widest instruction set available.
+The values are the same as the ones returned by the scalar version.
+\param p Points.
+\param v Returned values.
+\param n Number of points.
+*/
+void PerlinNoise::GetValue(const Vector3* p, float* v, int n)
+{
+	alignas(32) float x[NoiseBlock], y[NoiseBlock], z[NoiseBlock], r[NoiseBlock];
+	for (int k = 0; k < n; k += NoiseBlock)
+	{
+		const int m = n - k < NoiseBlock ? n - k : NoiseBlock;
+		for (int i = 0; i < NoiseBlock; i++)
+		{
+			const Vector3& q = p[k + (i < m ? i : 0)];
+			x[i] = q.x;
+			y[i] = q.y;
+			z[i] = q.z;
+		}
+		Kernel(x, y, z, r);
+		for (int i = 0; i < m; i++)
+			v[k + i] = r[i];
+	}
+}
+
+/*!
+\brief Compute the fractal sum of noise at a set of points.
+\param p Points.
+\param v Returned values.
+\param n Number of points.
+\param a Amplitude of the first octave.
+\param f Frequency of the first octave.
+\param o Number of octaves.
+*/
+void PerlinNoise::fBm(const Vector3* p, float* v, int n, float a, float f, int o)
+{
+	const int block = 64;
+	Vector3 q[block];
+	float r[block];
+	for (int k = 0; k < n; k += block)
+	{
+		const int m = n - k < block ? n - k : block;
+		for (int i = 0; i < m; i++)
+			v[k + i] = 0.0f;
+		float freq = f;
+		float amp = a;
+		for (int j = 0; j < o; j++)
+		{
+			for (int i = 0; i < m; i++)
+				q[i] = p[k + i] * freq;
+			GetValue(q, r, m);
+			for (int i = 0; i < m; i++)
+				v[k + i] += (r[i] * 0.5f + 0.5f) * amp;
+			amp *= 0.5f;
+			freq *= 2.0f;
+		}
+	}
+}
@@ -1,6 +1,5 @@
 #include "ttree.h"
 #include "geotree.h"
-#include "bvh.h"
 
 /*
 	This example slightly differ from the explanation I gave in my talk at Siggraph Asia 2019.
@@ -49,7 +48,7 @@ static void ErodeWithPrimitives(TTree* tree, GeoTree* geoTree, float primitiveEn
 	const float primitiveRadius = 8.0f;
 	const float slopeTolerance = 0.8f;
 
-	std::vector<TNode*> nodes;
+	std::vector<Vector3> centers;
 	std::vector<Vector3> poisson;
 	for (int i = 0; i < sampleCount; i++)
 	{
@@ -71,26 +70,29 @@ static void ErodeWithPrimitives(TTree* tree, GeoTree* geoTree, float primitiveEn
 		// Accounting to hardness
 		float hardness = Math::Clamp(geoTree->Intensity(p));
 		if (hardness < hardnessMax)
-			nodes.push_back(new TVertex(p, primitiveRadius, primitiveEnergy));
+			centers.push_back(p);
 		poisson.push_back(p);
 	}
-	if (nodes.size() > 0)
-		tree->Blend(TTreeBVH::OptimizeHierarchy(nodes, 0, int(nodes.size())));
-	std::cout << "Eroded with " << nodes.size() << " primitives " << std::endl;
+	if (centers.size() > 0)
+		tree->Blend(new TVertexCloud(centers, primitiveRadius, primitiveEnergy));
+	std::cout << "Eroded with " << centers.size() << " primitives " << std::endl;
 }
 
 /*!
-\brief Todo
+\brief Entry point of the Sea erosion scene.
+\return the terrain tree.
 */
-void SeaScene()
+TTree* SeaScene()
 {
-	// Terrain Tree
+	// Terrain Tree, whose nodes are allocated from its arena
 	const float sizeX = 1000;
 	const float sizeY = 1000;
 	const float minAlt = 0;
 	const float maxAlt = 100;
 	const Box2D bbox = Box2D(Vector2(-sizeY / 2.0, -sizeX / 2.0), Vector2(sizeY / 2.0, sizeX / 2.0));
-	TTree* terrainTree = new TTree(new TAnalyticCliff(bbox.ToBox(minAlt, maxAlt), Vector2(minAlt, maxAlt)));
+	TArena* arena = new TArena;
+	TArena::Scope scope(arena);
+	TTree* terrainTree = new TTree(new TAnalyticCliff(bbox.ToBox(minAlt, maxAlt), Vector2(minAlt, maxAlt)), arena);
 
 	// Geology Tree
 	// A weak strata primitive is defined at the sea-level.
@@ -107,7 +109,6 @@ void SeaScene()
 		ErodeWithPrimitives(terrainTree, geoTree, -8.0);
 	}
 
-	// Export
-	marching_cube("sea.obj", terrainTree, 350);
 	std::cout << std::endl;
+	return terrainTree;
 }
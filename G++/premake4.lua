@@ -16,6 +16,7 @@ solution "ImplicitTerrains"
 		buildoptions { "-std=c++14" }
 		buildoptions { "-w" }
 		buildoptions { "-flto -g"}
+		buildoptions { "-fopenmp"}
 		linkoptions { "-fopenmp"}
 		linkoptions { "-flto"}
 		linkoptions { "-g"}